@@ -0,0 +1,417 @@
+#pragma once
+
+// Thread placement and NUMA first-touch allocation shared by the benchmarks.
+// Topology comes from /sys/devices/system/{cpu,node}; elsewhere every
+// logical CPU is treated as its own core on node 0. Buffers are mapped with
+// the page backend chosen by --pages (4 KiB, transparent or explicit huge
+// pages), so TLB overhead is a controlled variable.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_args.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <mm_malloc.h>
+#endif
+
+struct LogicalCpu {
+    int cpu;
+    int core;       // core_id, unique within a package
+    int package;
+    int node;
+    int smt_rank;   // 0 for the first hardware thread of a core, 1 for its sibling, ...
+};
+
+enum AffinityPolicy {
+    AFFINITY_NONE,      // leave placement to the OS scheduler
+    AFFINITY_COMPACT,   // fill a node, SMT siblings next to each other, then the next node
+    AFFINITY_SCATTER,   // round-robin over nodes, one thread per physical core first
+    AFFINITY_PHYSICAL,  // every physical core in node order, then the SMT siblings
+    AFFINITY_LIST       // explicit CPU list
+};
+
+struct AffinityConfig {
+    AffinityPolicy policy = AFFINITY_SCATTER;
+    std::vector<int> cpus; // AFFINITY_LIST only
+};
+
+// Parses the kernel's cpulist format, e.g. "0-3,8,10-11".
+inline std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream ss(text);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range[0] < '0' || range[0] > '9')
+            continue;
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+inline std::string read_sysfs_line(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+inline int read_sysfs_int(const std::string& path, int fallback) {
+    std::string line = read_sysfs_line(path);
+    return line.empty() ? fallback : std::atoi(line.c_str());
+}
+
+inline std::vector<LogicalCpu> read_cpu_topology() {
+    std::vector<LogicalCpu> cpus;
+    std::vector<int> online = parse_cpu_list(read_sysfs_line("/sys/devices/system/cpu/online"));
+    if (online.empty()) {
+        unsigned count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < count; i++)
+            cpus.push_back({ static_cast<int>(i), static_cast<int>(i), 0, 0, 0 });
+        return cpus;
+    }
+
+    for (int cpu : online) {
+        std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        cpus.push_back({ cpu, read_sysfs_int(base + "core_id", cpu),
+                         read_sysfs_int(base + "physical_package_id", 0), 0, 0 });
+    }
+
+    for (int node : parse_cpu_list(read_sysfs_line("/sys/devices/system/node/online"))) {
+        std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        for (int cpu : parse_cpu_list(read_sysfs_line(path)))
+            for (LogicalCpu& c : cpus)
+                if (c.cpu == cpu)
+                    c.node = node;
+    }
+
+    // Rank hardware threads within their core by CPU number.
+    for (LogicalCpu& c : cpus)
+        for (const LogicalCpu& other : cpus)
+            if (other.package == c.package && other.core == c.core && other.cpu < c.cpu)
+                c.smt_rank++;
+    return cpus;
+}
+
+inline std::vector<int> topology_nodes(const std::vector<LogicalCpu>& topology) {
+    std::vector<int> nodes;
+    for (const LogicalCpu& c : topology)
+        if (std::find(nodes.begin(), nodes.end(), c.node) == nodes.end())
+            nodes.push_back(c.node);
+    std::sort(nodes.begin(), nodes.end());
+    return nodes;
+}
+
+inline std::vector<int> node_cpus(const std::vector<LogicalCpu>& topology, int node) {
+    std::vector<int> cpus;
+    for (const LogicalCpu& c : topology)
+        if (c.node == node)
+            cpus.push_back(c.cpu);
+    return cpus;
+}
+
+// Order in which threads 0, 1, 2, ... are placed. Running with N threads
+// uses the first N entries, so one order serves the whole thread sweep.
+inline std::vector<int> affinity_order(const AffinityConfig& config) {
+    if (config.policy == AFFINITY_LIST)
+        return config.cpus;
+
+    std::vector<LogicalCpu> topology = read_cpu_topology();
+    std::vector<LogicalCpu> order = topology;
+    auto core_key = [](const LogicalCpu& c) { return std::make_pair(c.package, c.core); };
+
+    switch (config.policy) {
+    case AFFINITY_COMPACT:
+        std::sort(order.begin(), order.end(), [&](const LogicalCpu& a, const LogicalCpu& b) {
+            if (a.node != b.node) return a.node < b.node;
+            if (core_key(a) != core_key(b)) return core_key(a) < core_key(b);
+            return a.smt_rank < b.smt_rank;
+        });
+        break;
+    case AFFINITY_PHYSICAL:
+        std::sort(order.begin(), order.end(), [&](const LogicalCpu& a, const LogicalCpu& b) {
+            if (a.smt_rank != b.smt_rank) return a.smt_rank < b.smt_rank;
+            if (a.node != b.node) return a.node < b.node;
+            return core_key(a) < core_key(b);
+        });
+        break;
+    case AFFINITY_SCATTER: {
+        // Position of each CPU among same-rank CPUs of its node; sorting by
+        // (rank, position, node) deals threads out across nodes in turn.
+        std::vector<int> position(order.size(), 0);
+        for (size_t i = 0; i < order.size(); i++)
+            for (size_t j = 0; j < order.size(); j++)
+                if (order[j].node == order[i].node && order[j].smt_rank == order[i].smt_rank &&
+                    core_key(order[j]) < core_key(order[i]))
+                    position[i]++;
+        std::vector<size_t> index(order.size());
+        for (size_t i = 0; i < index.size(); i++)
+            index[i] = i;
+        std::sort(index.begin(), index.end(), [&](size_t a, size_t b) {
+            if (order[a].smt_rank != order[b].smt_rank) return order[a].smt_rank < order[b].smt_rank;
+            if (position[a] != position[b]) return position[a] < position[b];
+            return order[a].node < order[b].node;
+        });
+        std::vector<LogicalCpu> scattered;
+        for (size_t i : index)
+            scattered.push_back(order[i]);
+        order = scattered;
+        break;
+    }
+    default:
+        break;
+    }
+
+    std::vector<int> cpus;
+    for (const LogicalCpu& c : order)
+        cpus.push_back(config.policy == AFFINITY_NONE ? -1 : c.cpu);
+    return cpus;
+}
+
+// Accepts none, compact, scatter, physical or an explicit list like 0,2,4-7.
+inline bool parse_affinity(const std::string& text, AffinityConfig& config) {
+    if (text == "none")          config.policy = AFFINITY_NONE;
+    else if (text == "compact")  config.policy = AFFINITY_COMPACT;
+    else if (text == "scatter")  config.policy = AFFINITY_SCATTER;
+    else if (text == "physical") config.policy = AFFINITY_PHYSICAL;
+    else {
+        config.policy = AFFINITY_LIST;
+        config.cpus = parse_cpu_list(text);
+        return !config.cpus.empty();
+    }
+    return true;
+}
+
+inline const char* affinity_name(AffinityPolicy policy) {
+    switch (policy) {
+    case AFFINITY_NONE:     return "none";
+    case AFFINITY_COMPACT:  return "compact";
+    case AFFINITY_SCATTER:  return "scatter";
+    case AFFINITY_PHYSICAL: return "physical";
+    default:                return "list";
+    }
+}
+
+inline std::string describe_affinity(const AffinityConfig& config, const std::vector<int>& cpus) {
+    std::string text = std::string("Affinity: ") + affinity_name(config.policy);
+    if (config.policy != AFFINITY_NONE) {
+        text += " (";
+        for (size_t i = 0; i < cpus.size(); i++)
+            text += (i ? "," : "") + std::to_string(cpus[i]);
+        text += ")";
+    }
+    return text;
+}
+
+// Pins the calling thread to one logical CPU; cpu < 0 leaves it unpinned.
+inline bool pin_current_thread(int cpu) {
+    if (cpu < 0)
+        return false;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    return cpu < 64 && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+    return false;
+#endif
+}
+
+//------------------------//
+// Page backends
+//------------------------//
+
+enum PageBackend {
+    PAGES_DEFAULT,      // anonymous mmap, THP as the system is configured
+    PAGES_NO_THP,       // MADV_NOHUGEPAGE: 4 KiB pages only
+    PAGES_THP,          // MADV_HUGEPAGE: transparent 2 MiB pages where the kernel can
+    PAGES_HUGETLB_2M,   // MAP_HUGETLB 2 MiB, from the reserved pool
+    PAGES_HUGETLB_1G,   // MAP_HUGETLB 1 GiB, from the reserved pool
+    PAGE_BACKEND_COUNT
+};
+
+const char* const PAGE_BACKEND_NAMES[PAGE_BACKEND_COUNT] = { "default", "nothp", "thp", "2m", "1g" };
+
+// Granularity of a mapping: sizes are rounded up to it.
+inline size_t page_backend_size(PageBackend backend) {
+    switch (backend) {
+    case PAGES_HUGETLB_2M: return 2ULL << 20;
+    case PAGES_HUGETLB_1G: return 1ULL << 30;
+    default:               return 4096;
+    }
+}
+
+inline size_t round_to_pages(size_t size, PageBackend backend) {
+    size_t page = page_backend_size(backend);
+    return (size + page - 1) / page * page;
+}
+
+// Backend for every first_touch_alloc() that doesn't name one, from --pages.
+inline PageBackend& page_backend() {
+    static PageBackend backend = PAGES_DEFAULT;
+    return backend;
+}
+
+inline bool parse_page_backend(const std::string& text, PageBackend& backend) {
+    for (int b = 0; b < PAGE_BACKEND_COUNT; b++) {
+        if (text == PAGE_BACKEND_NAMES[b]) {
+            backend = PageBackend(b);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reads --pages=default|nothp|thp|2m|1g from the command line.
+inline void pages_from_args(int& argc, char** argv) {
+    std::string value;
+    if (take_option(argc, argv, "--pages", value) && !parse_page_backend(value, page_backend()))
+        std::cerr << "Unknown --pages '" << value << "', using default\n";
+}
+
+// "Pages: thp (THP enabled [madvise], defrag [madvise], 0 of 512 reserved 2 MiB pages free)"
+inline std::string describe_pages(PageBackend backend) {
+    std::string text = std::string("Pages: ") + PAGE_BACKEND_NAMES[backend];
+#ifdef __linux__
+    std::string thp = read_sysfs_line("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string defrag = read_sysfs_line("/sys/kernel/mm/transparent_hugepage/defrag");
+    auto selected = [](const std::string& line) {
+        size_t open = line.find('['), close = line.find(']');
+        return open == std::string::npos || close == std::string::npos ? std::string("n/a")
+                                                                       : line.substr(open, close - open + 1);
+    };
+    text += " (THP enabled " + selected(thp) + ", defrag " + selected(defrag);
+    std::string pool = "/sys/kernel/mm/hugepages/hugepages-";
+    if (backend == PAGES_HUGETLB_2M || backend == PAGES_HUGETLB_1G) {
+        pool += backend == PAGES_HUGETLB_2M ? "2048kB/" : "1048576kB/";
+        text += ", " + std::to_string(read_sysfs_int(pool + "free_hugepages", 0)) + " of " +
+                std::to_string(read_sysfs_int(pool + "nr_hugepages", 0)) + " reserved " +
+                (backend == PAGES_HUGETLB_2M ? "2 MiB" : "1 GiB") + " pages free";
+    }
+    text += ")";
+#endif
+    return text;
+}
+
+// Bytes of this process's anonymous memory currently backed by transparent
+// huge pages (AnonHugePages in /proc/self/smaps_rollup), 0 where unknown.
+inline size_t anon_huge_bytes() {
+    std::ifstream file("/proc/self/smaps_rollup");
+    std::string line;
+    while (std::getline(file, line))
+        if (line.compare(0, 14, "AnonHugePages:") == 0)
+            return std::strtoull(line.c_str() + 14, nullptr, 10) * 1024;
+    return 0;
+}
+
+#ifdef __linux__
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
+// Maps `size` bytes (rounded up to the backend's page size) without touching
+// them. Explicit huge pages fail when the reserved pool is too small; the
+// error says how to grow it.
+inline char* map_pages(size_t size, PageBackend backend) {
+#ifdef __linux__
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (backend == PAGES_HUGETLB_2M) flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+    if (backend == PAGES_HUGETLB_1G) flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+    size_t length = round_to_pages(size, backend);
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mapping == MAP_FAILED) {
+        if (flags & MAP_HUGETLB)
+            std::cerr << "MAP_HUGETLB " << (backend == PAGES_HUGETLB_2M ? "2 MiB" : "1 GiB") << " for " << length
+                      << " bytes failed: reserve pages in /sys/kernel/mm/hugepages/hugepages-"
+                      << (backend == PAGES_HUGETLB_2M ? "2048kB" : "1048576kB") << "/nr_hugepages\n";
+        return nullptr;
+    }
+    if (backend == PAGES_THP && madvise(mapping, length, MADV_HUGEPAGE) != 0)
+        std::cerr << "MADV_HUGEPAGE failed (THP disabled in this kernel?)\n";
+    if (backend == PAGES_NO_THP)
+        madvise(mapping, length, MADV_NOHUGEPAGE);
+    return static_cast<char*>(mapping);
+#else
+    if (backend != PAGES_DEFAULT)
+        return nullptr;
+    return static_cast<char*>(_mm_malloc(size, 4096));
+#endif
+}
+
+inline void unmap_pages(char* memory, size_t size, PageBackend backend) {
+#ifdef __linux__
+    munmap(memory, round_to_pages(size, backend));
+#else
+    (void)size;
+    (void)backend;
+    _mm_free(memory);
+#endif
+}
+
+//------------------------//
+// First-touch allocation
+//------------------------//
+
+// Allocates `size` bytes without touching them, then lets thread i (pinned to
+// cpus[i]) write the i-th of thread_count equal chunks, so each chunk's pages
+// land on the NUMA node of the thread that will use it.
+inline char* first_touch_alloc(size_t size, int thread_count, const std::vector<int>& cpus,
+                               PageBackend backend = page_backend()) {
+    char* memory = map_pages(size, backend);
+    if (!memory)
+        return nullptr;
+    size_t chunk_size = size / thread_count;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; i++) {
+        threads.push_back(std::thread([=] {
+            pin_current_thread(cpus[i % cpus.size()]);
+            size_t length = i == thread_count - 1 ? size - i * chunk_size : chunk_size;
+            std::memset(memory + i * chunk_size, 0, length);
+        }));
+    }
+    for (auto& t : threads)
+        t.join();
+    return memory;
+}
+
+inline void first_touch_free(char* memory, size_t size, PageBackend backend = page_backend()) {
+    unmap_pages(memory, size, backend);
+}
+
+// Reads --affinity=... from the command line (default scatter) and returns
+// the CPU order for threads 0..N-1.
+inline std::vector<int> affinity_from_args(int& argc, char** argv, AffinityConfig& config) {
+    std::string value;
+    if (take_option(argc, argv, "--affinity", value) && !parse_affinity(value, config)) {
+        std::cerr << "Unknown --affinity '" << value << "', using scatter\n";
+        config = AffinityConfig();
+    }
+    return affinity_order(config);
+}
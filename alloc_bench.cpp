@@ -0,0 +1,451 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <immintrin.h>
+
+#include "affinity.h"
+#include "bench_args.h"
+#include "bench_report.h"
+#include "bench_stats.h"
+#include "cpu_clock.h"
+#include "cpu_topology.h"
+#include "worker_pool.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+std::vector<int> thread_cpus; // CPUs taking part, from --affinity
+MeasureConfig measure_config; // warmup and repetitions, from --warmup/--reps/...
+BenchReport report; // --json/--csv/--compare
+
+//------------------------//
+// First-touch page faults
+//------------------------//
+
+const size_t FAULT_BYTES_PER_THREAD = 64ULL << 20;
+
+// One fresh mapping per sample, untouched until the timed region, where
+// every thread writes one byte per page of its share. Only the touching is
+// timed; the mapping and the unmap are not. All threads fault into the
+// same address space, as a service's threads do, so the page-table and
+// mapping locks are part of what scales or doesn't.
+int run_page_faults(WorkerPool& pool) {
+    PageBackend backend = page_backend();
+    size_t page = page_backend_size(backend);
+    size_t per_thread = FAULT_BYTES_PER_THREAD;
+    size_t memory = cpu_topology().memory_bytes;
+    if (memory)
+        per_thread = std::min(per_thread, memory / 4 / thread_cpus.size() / page * page);
+    per_thread = std::max(per_thread, page);
+
+    std::cout << "First-touch faults: " << format_size(per_thread) << " per thread, one write per "
+              << format_size(page) << " page, median\n";
+    std::cout << std::setw(8) << "Threads" << std::setw(14) << "Mpages/s" << std::setw(10) << "GB/s"
+              << std::setw(12) << "us/page" << std::setw(8) << "CI95" << "\n";
+
+    for (int threads : sweep_thread_counts(thread_cpus.size())) {
+        size_t size = per_thread * threads;
+        bool failed = false;
+        SampleStats stats = measure(measure_config, [&] {
+            char* mapping = map_pages(size, backend);
+            if (!mapping) {
+                failed = true;
+                return 0.0;
+            }
+            double seconds = pool.run(threads, [&](int i) {
+                char* base = mapping + i * per_thread;
+                for (size_t offset = 0; offset < per_thread; offset += page)
+                    base[offset] = 1;
+            });
+            unmap_pages(mapping, size, backend);
+            return seconds;
+        });
+        if (failed) {
+            std::cerr << "Cannot map " << format_size(size) << " of " << PAGE_BACKEND_NAMES[backend] << " pages\n";
+            return 1;
+        }
+
+        double pages = double(size / page);
+        double gb = size / (1024.0 * 1024.0 * 1024.0);
+        ResultParams params = {{"threads", std::to_string(threads)}, {"pages", PAGE_BACKEND_NAMES[backend]}};
+        report.add_rate("faults", params, "fault_rate", "Mpages/s", stats, pages / 1e6);
+        report.add_rate("faults", params, "fault_bandwidth", "GB/s", stats, gb);
+        std::cout << std::fixed << std::setprecision(2) << std::setw(8) << threads << std::setw(14)
+                  << pages / 1e6 / stats.median << std::setw(10) << gb / stats.median << std::setw(12)
+                  << stats.median * 1e6 / (pages / threads) << std::setw(7) << 100.0 * stats.ci << "%\n";
+    }
+    return 0;
+}
+
+//------------------------//
+// mmap/munmap
+//------------------------//
+
+const size_t MMAP_SIZES[] = { 4096, 64 * 1024, 2 << 20, 64 << 20 };
+const int MMAP_CALLS = 2000; // map/unmap pairs per thread per sample
+
+// Microseconds per map + unmap pair of an untouched region, so this is
+// the system-call and VMA cost alone (faults are the mode above), for one
+// thread and for every --affinity thread at once.
+int run_mmap(WorkerPool& pool) {
+    PageBackend backend = page_backend();
+    int all = thread_cpus.size();
+    std::cout << "mmap + munmap of untouched " << PAGE_BACKEND_NAMES[backend] << " mappings, median us per pair\n";
+    std::vector<int> counts = { 1 };
+    if (all > 1)
+        counts.push_back(all);
+    std::cout << std::setw(10) << "Size" << std::setw(12) << "1 thread";
+    if (all > 1)
+        std::cout << std::setw(12) << (std::to_string(all) + " threads");
+    std::cout << "\n";
+
+    for (size_t size : MMAP_SIZES) {
+        size = round_to_pages(size, backend);
+        std::cout << std::setw(10) << format_size(size);
+        for (int threads : counts) {
+            std::atomic<bool> failed(false);
+            SampleStats stats = measure(measure_config, [&] {
+                return pool.run(threads, [&](int) {
+                    for (int call = 0; call < MMAP_CALLS; call++) {
+                        char* mapping = map_pages(size, backend);
+                        if (!mapping) {
+                            failed.store(true, std::memory_order_relaxed);
+                            return;
+                        }
+                        unmap_pages(mapping, size, backend);
+                    }
+                });
+            });
+            if (failed) {
+                std::cout << std::setw(12) << "n/a";
+                continue;
+            }
+            ResultParams params = {{"size", format_size(size)}, {"threads", std::to_string(threads)},
+                                   {"pages", PAGE_BACKEND_NAMES[backend]}};
+            report.add_time("mmap", params, "map_unmap", "us", stats, 1e6 / MMAP_CALLS);
+            std::cout << std::fixed << std::setprecision(2) << std::setw(12) << stats.median * 1e6 / MMAP_CALLS;
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
+
+//------------------------//
+// Thread pool allocator
+//------------------------//
+
+// Per-thread size-class free lists, the shape of tcmalloc's and
+// jemalloc's thread caches without their tuning. Blocks are powers of two
+// carved from chunks the owning thread maps; a 16-byte header names the
+// owner and class. A free by the owner pushes on its local list; a free by
+// any other thread pushes on the owner's lock-free remote list, which the
+// owner takes whole when its local list runs dry. Nothing is returned to
+// the system until the allocator is destroyed.
+const int POOL_CLASSES = 24;               // blocks of 2^0 .. 2^23 bytes, header included
+const size_t POOL_HEADER = 16;
+const size_t POOL_CHUNK = 1 << 20;         // smallest chunk mapped at a time
+
+struct PoolBlock {
+    PoolBlock* next;
+};
+
+struct PoolHeader {
+    uint32_t owner;
+    uint32_t size_class;
+};
+
+struct alignas(64) PoolThread {
+    PoolBlock* local[POOL_CLASSES];
+    std::atomic<PoolBlock*> remote[POOL_CLASSES];
+    std::vector<std::pair<char*, size_t>> chunks;
+};
+
+class ThreadPoolAllocator {
+public:
+    explicit ThreadPoolAllocator(int threads) : threads_(threads) {
+        for (PoolThread& t : threads_) {
+            std::fill(t.local, t.local + POOL_CLASSES, nullptr);
+            for (auto& r : t.remote)
+                r.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~ThreadPoolAllocator() {
+        for (PoolThread& t : threads_)
+            for (auto& chunk : t.chunks)
+                unmap_pages(chunk.first, chunk.second, PAGES_DEFAULT);
+    }
+
+    ThreadPoolAllocator(const ThreadPoolAllocator&) = delete;
+    ThreadPoolAllocator& operator=(const ThreadPoolAllocator&) = delete;
+
+    void* allocate(int thread, size_t size) {
+        int size_class = 5; // 32-byte blocks at least: header plus one 16-byte slot
+        while ((size_t(1) << size_class) < size + POOL_HEADER)
+            size_class++;
+        if (size_class >= POOL_CLASSES)
+            return nullptr;
+
+        PoolThread& t = threads_[thread];
+        PoolBlock* block = t.local[size_class];
+        if (!block)
+            block = t.remote[size_class].exchange(nullptr, std::memory_order_acquire);
+        if (!block)
+            block = refill(t, size_class);
+        if (!block)
+            return nullptr;
+        t.local[size_class] = block->next;
+
+        PoolHeader* header = reinterpret_cast<PoolHeader*>(block);
+        header->owner = thread;
+        header->size_class = size_class;
+        return reinterpret_cast<char*>(block) + POOL_HEADER;
+    }
+
+    void release(int thread, void* memory) {
+        PoolHeader* header = reinterpret_cast<PoolHeader*>(static_cast<char*>(memory) - POOL_HEADER);
+        PoolThread& owner = threads_[header->owner];
+        int size_class = header->size_class;
+        PoolBlock* block = reinterpret_cast<PoolBlock*>(header);
+        if (int(header->owner) == thread) {
+            block->next = owner.local[size_class];
+            owner.local[size_class] = block;
+            return;
+        }
+        block->next = owner.remote[size_class].load(std::memory_order_relaxed);
+        while (!owner.remote[size_class].compare_exchange_weak(block->next, block, std::memory_order_release,
+                                                               std::memory_order_relaxed))
+            ;
+    }
+
+private:
+    // Maps a chunk of at least four blocks and threads them onto the list.
+    PoolBlock* refill(PoolThread& t, int size_class) {
+        size_t block_size = size_t(1) << size_class;
+        size_t chunk_size = std::max(POOL_CHUNK, 4 * block_size);
+        char* chunk = map_pages(chunk_size, PAGES_DEFAULT);
+        if (!chunk)
+            return nullptr;
+        t.chunks.push_back(std::make_pair(chunk, chunk_size));
+        PoolBlock* head = nullptr;
+        for (size_t offset = chunk_size; offset >= block_size; offset -= block_size) {
+            PoolBlock* block = reinterpret_cast<PoolBlock*>(chunk + offset - block_size);
+            block->next = head;
+            head = block;
+        }
+        return head;
+    }
+
+    std::vector<PoolThread> threads_;
+};
+
+//------------------------//
+// malloc/free rates
+//------------------------//
+
+struct SizeClass {
+    const char* name;
+    size_t min_size, max_size;
+    uint64_t ops; // allocations per thread per sample
+};
+
+// Large starts past glibc's mmap threshold, which run_malloc() pins at
+// 128 KiB, so its allocations are system calls there.
+const size_t MMAP_THRESHOLD = 128 * 1024;
+const SizeClass SIZE_CLASSES[] = {
+    { "small",  16,         256,        200000 },
+    { "medium", 1024,       32 * 1024,  50000 },
+    { "large",  256 * 1024, 4 << 20,    2000 },
+};
+
+enum AllocPattern {
+    ALLOC_LOCAL,     // each thread frees its own blocks, 64 live at a time
+    ALLOC_HANDOFF    // thread 2k allocates, thread 2k+1 frees, over a ring
+};
+
+const char* const ALLOC_PATTERN_NAMES[] = { "local", "producer-consumer" };
+
+const size_t LIVE_BLOCKS = 64;
+const uint64_t HANDOFF_RING = 256; // power of two
+
+inline uint64_t next_random(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// One producer/consumer pair's ring of pointers, indices on their own lines.
+struct HandoffRing {
+    WorkerSlot<std::atomic<uint64_t>> head; // next to take, written by the consumer
+    WorkerSlot<std::atomic<uint64_t>> tail; // next to fill, written by the producer
+    void* items[HANDOFF_RING];
+};
+
+// Either allocator behind one interface: the glibc one ignores the thread.
+struct AllocatorApi {
+    const char* name;
+    bool pool;
+};
+
+const AllocatorApi ALLOCATORS[] = { { "glibc", false }, { "pool", true } };
+
+// Seconds per sample of `threads` workers doing `c.ops` allocations each
+// (pairs: per producer), every block written once so it is really used.
+SampleStats measure_alloc(WorkerPool& pool, const AllocatorApi& api, const SizeClass& c, AllocPattern pattern,
+                          int threads) {
+    ThreadPoolAllocator pool_allocator(threads);
+    auto allocate = [&](int thread, size_t size) {
+        void* p = api.pool ? pool_allocator.allocate(thread, size) : std::malloc(size);
+        if (p)
+            static_cast<volatile char*>(p)[0] = 1;
+        return p;
+    };
+    auto release = [&](int thread, void* p) {
+        if (api.pool)
+            pool_allocator.release(thread, p);
+        else
+            std::free(p);
+    };
+    uint64_t span = c.max_size - c.min_size + 1;
+    std::vector<HandoffRing> rings(threads / 2);
+
+    return measure(measure_config, [&] {
+        for (HandoffRing& ring : rings) {
+            ring.head.value.store(0);
+            ring.tail.value.store(0);
+        }
+        return pool.run(threads, [&](int i) {
+            uint64_t random = 0x9E3779B97F4A7C15ULL * (i + 1);
+            if (pattern == ALLOC_LOCAL) {
+                void* live[LIVE_BLOCKS] = {};
+                for (uint64_t op = 0; op < c.ops; op++) {
+                    void*& slot = live[op % LIVE_BLOCKS];
+                    if (slot)
+                        release(i, slot);
+                    slot = allocate(i, c.min_size + next_random(random) % span);
+                }
+                for (void* p : live)
+                    if (p)
+                        release(i, p);
+                return;
+            }
+            if (i >= threads / 2 * 2)
+                return;
+            HandoffRing& ring = rings[i / 2];
+            for (uint64_t op = 0; op < c.ops; op++) {
+                if (i % 2 == 0) {
+                    void* p = allocate(i, c.min_size + next_random(random) % span);
+                    while (op - ring.head.value.load(std::memory_order_acquire) == HANDOFF_RING)
+                        _mm_pause();
+                    ring.items[op % HANDOFF_RING] = p;
+                    ring.tail.value.store(op + 1, std::memory_order_release);
+                } else {
+                    while (ring.tail.value.load(std::memory_order_acquire) == op)
+                        _mm_pause();
+                    void* p = ring.items[op % HANDOFF_RING];
+                    ring.head.value.store(op + 1, std::memory_order_release);
+                    if (p)
+                        release(i, p);
+                }
+            }
+        });
+    });
+}
+
+// Allocation + free rates per size class, pattern and thread count, glibc
+// malloc against the thread pool allocator. Rates count allocations (each
+// with its free) per second over all threads.
+int run_malloc(WorkerPool& pool) {
+    std::vector<int> counts = sweep_thread_counts(thread_cpus.size());
+    std::cout << "malloc/free, median M allocations/s over all threads (each block written once and freed)\n";
+#ifdef __GLIBC__
+    // By default glibc raises the threshold to the size of each mmapped
+    // chunk freed, after which large blocks come from the heap. Setting it
+    // turns that off.
+    mallopt(M_MMAP_THRESHOLD, MMAP_THRESHOLD);
+    std::cout << "glibc mmap threshold pinned at " << format_size(MMAP_THRESHOLD) << "\n";
+#endif
+    for (const SizeClass& c : SIZE_CLASSES) {
+        std::cout << "-----------------------\n";
+        std::cout << c.name << ": " << format_size(c.min_size) << " to " << format_size(c.max_size) << ", "
+                  << c.ops << " per thread per sample\n";
+        std::cout << std::left << std::setw(20) << "Pattern" << std::right << std::setw(8) << "Threads";
+        for (const AllocatorApi& api : ALLOCATORS)
+            std::cout << std::setw(10) << api.name;
+        std::cout << std::setw(12) << "pool/glibc" << "\n";
+
+        for (int p = ALLOC_LOCAL; p <= ALLOC_HANDOFF; p++) {
+            for (int threads : counts) {
+                if (p == ALLOC_HANDOFF && threads < 2)
+                    continue;
+                // Producer-consumer counts the producers' allocations only.
+                double allocations = double(c.ops) * (p == ALLOC_HANDOFF ? threads / 2 : threads);
+                std::cout << std::left << std::setw(20) << ALLOC_PATTERN_NAMES[p] << std::right << std::setw(8)
+                          << threads << std::fixed << std::setprecision(2);
+                std::vector<double> rates;
+                for (const AllocatorApi& api : ALLOCATORS) {
+                    SampleStats stats = measure_alloc(pool, api, c, AllocPattern(p), threads);
+                    ResultParams params = {{"size", c.name}, {"pattern", ALLOC_PATTERN_NAMES[p]},
+                                           {"threads", std::to_string(threads)}, {"allocator", api.name}};
+                    report.add_rate("malloc", params, "alloc_rate", "M/s", stats, allocations / 1e6);
+                    rates.push_back(allocations / 1e6 / stats.median);
+                    std::cout << std::setw(10) << rates.back();
+                }
+                std::cout << std::setw(11) << rates[1] / rates[0] << "x\n";
+            }
+        }
+    }
+    return 0;
+}
+
+// Usage: alloc_bench [all]                faults, mmap and malloc below
+//        alloc_bench faults               first-touch page faults per second over the thread sweep,
+//                                         64 MiB per thread in one shared mapping
+//        alloc_bench mmap                 mmap + munmap of untouched 4 KiB..64 MiB regions, one
+//                                         thread and all
+//        alloc_bench malloc               small/medium/large malloc/free, thread-local and
+//                                         producer-consumer, glibc vs a per-thread pool allocator
+// Options: --affinity=scatter|compact|physical|<cpu list> (default: every CPU)
+//          --pages=default|nothp|thp|2m|1g for the faults and mmap modes
+//          --warmup=N --reps=N | --min-reps=N --max-reps=N --max-time=S --ci=PCT, --outliers=K
+//          --json=FILE --csv=FILE --compare=BASELINE.json --threshold=PCT, --timer=tsc|steady
+int main(int argc, char** argv) {
+    report.init("alloc_bench", argc, argv);
+    AffinityConfig affinity;
+    thread_cpus = affinity_from_args(argc, argv, affinity);
+    pages_from_args(argc, argv);
+    measure_config_from_args(argc, argv, measure_config);
+    timer_from_args(argc, argv);
+    report.set_placement(affinity, thread_cpus);
+    report.set_sampling(measure_config);
+
+    std::cout << "CPU: " << cpu_info().brand << "\n";
+    std::cout << describe_measure_config(measure_config) << "\n";
+    std::cout << describe_timer() << "\n";
+    std::cout << describe_topology(cpu_topology()) << "\n";
+    std::cout << describe_affinity(affinity, thread_cpus) << "\n";
+    std::cout << describe_pages(page_backend()) << "\n";
+    std::cout << "-----------------------\n";
+
+    std::string mode = argc > 1 ? argv[1] : "all";
+    if (mode != "all" && mode != "faults" && mode != "mmap" && mode != "malloc") {
+        std::cerr << "Unknown mode '" << mode << "'\n";
+        return report.finish(1);
+    }
+    WorkerPool pool(thread_cpus);
+    int status = 0;
+    if (mode == "all" || mode == "faults")
+        status |= run_page_faults(pool);
+    if (mode == "all" || mode == "mmap")
+        status |= run_mmap(pool);
+    if (mode == "all" || mode == "malloc")
+        status |= run_malloc(pool);
+    return report.finish(status);
+}
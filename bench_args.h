@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+
+// Removes "--name=value" (or a bare "--name") from argv and returns whether
+// it was present. Positional arguments keep their order, so each program's
+// mode parsing works the same with or without options.
+inline bool take_option(int& argc, char** argv, const char* name, std::string& value) {
+    size_t len = std::strlen(name);
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], name, len) != 0 || (argv[i][len] != '=' && argv[i][len] != '\0'))
+            continue;
+        value = argv[i][len] == '=' ? argv[i] + len + 1 : "";
+        for (int j = i; j + 1 < argc; j++)
+            argv[j] = argv[j + 1];
+        argc--;
+        return true;
+    }
+    return false;
+}
+
+// Like take_option(), but also accepts the value as the next argument
+// ("--name value"), for options that always take one such as file paths.
+inline bool take_value_option(int& argc, char** argv, const char* name, std::string& value) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::strcmp(argv[i], name) != 0)
+            continue;
+        value = argv[i + 1];
+        for (int j = i; j + 2 < argc; j++)
+            argv[j] = argv[j + 2];
+        argc -= 2;
+        return true;
+    }
+    return take_option(argc, argv, name, value) && !value.empty();
+}
@@ -0,0 +1,655 @@
+#pragma once
+
+// Machine-readable results. Every benchmark adds its metrics to a
+// BenchReport next to the human-readable lines; at exit the report is
+// written as JSON (--json=FILE) and/or CSV (--csv=FILE) with host metadata,
+// and --compare=BASELINE.json checks it against an earlier JSON report:
+// a metric regresses when it is worse by more than --threshold percent
+// (default 3) and the difference is significant at 95% (Welch's t-test on
+// the sample statistics). Single values (derived metrics such as IPC or a
+// clock, one-run percentiles) have no spread to test, so a change beyond the
+// threshold is only listed. Any regression makes the program exit with 2.
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "affinity.h"
+#include "bench_args.h"
+#include "bench_stats.h"
+#include "cpu_clock.h"
+#include "cpu_info.h"
+#include "cpu_topology.h"
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+typedef std::vector<std::pair<std::string, std::string>> ResultParams;
+
+inline ResultParams with_param(ResultParams params, const std::string& key, const std::string& value) {
+    params.push_back(std::make_pair(key, value));
+    return params;
+}
+
+// Cycles per operation for one measurement, per thread. Reference cycles
+// come from the median sample at the TSC rate; core cycles come from the
+// perf counters, which cover every run of the measurement including warmup.
+struct CycleStats {
+    double tsc_per_op = 0;
+    double core_per_op = 0;  // 0 without a cycle counter
+    double core_ghz = 0;     // actual clock while running, 0 without a cycle counter
+};
+
+inline CycleStats cycle_stats(const SampleStats& s, const PerfSample& counters, double ops_per_thread, int threads) {
+    CycleStats c;
+    c.tsc_per_op = s.median * tsc_info().hz / ops_per_thread;
+    if (counters.has(PERF_CYCLES) && s.runs > 0 && s.total_seconds > 0) {
+        c.core_per_op = counters[PERF_CYCLES] / (ops_per_thread * threads * s.runs);
+        c.core_ghz = counters[PERF_CYCLES] / (threads * s.total_seconds) / 1e9;
+    }
+    return c;
+}
+
+// "3.10 cycles/line, 0.32 lines/cycle (TSC); core 3.95 cycles/line at 3.80 GHz"
+inline std::string format_cycles(const CycleStats& c, const std::string& op) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(c.tsc_per_op < 10 ? 3 : 1) << c.tsc_per_op << " cycles/" << op << ", "
+         << std::setprecision(3) << 1.0 / c.tsc_per_op << " " << op << "s/cycle (TSC)";
+    if (c.core_per_op > 0)
+        text << "; core " << c.core_per_op << " cycles/" << op << " at " << std::setprecision(2) << c.core_ghz << " GHz";
+    return text.str();
+}
+
+struct ResultRecord {
+    std::string benchmark;   // mode or table, e.g. "sweep"
+    ResultParams params;     // what distinguishes this row, e.g. kernel, threads, size
+    std::string metric;      // e.g. "read_bandwidth"
+    std::string unit;
+    bool higher_is_better = true;
+    double value = 0;        // median
+    double best = 0, mean = 0, p95 = 0, p99 = 0;
+    double rel_stddev = 0, ci = 0;
+    int samples = 0, rejected = 0;
+
+    // Stable key used to match records against a baseline.
+    std::string id() const {
+        std::string text = benchmark;
+        for (const auto& p : params)
+            text += "/" + p.first + "=" + p.second;
+        return text + "/" + metric;
+    }
+};
+
+//------------------------//
+// Minimal JSON reader, enough for reading back our own reports
+//------------------------//
+
+struct JsonValue {
+    enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT } type = NUL;
+    bool boolean = false;
+    double number = 0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::map<std::string, JsonValue> fields;
+
+    const JsonValue* get(const std::string& key) const {
+        auto it = fields.find(key);
+        return it == fields.end() ? nullptr : &it->second;
+    }
+    double number_or(const std::string& key, double fallback) const {
+        const JsonValue* v = get(key);
+        return v && v->type == NUMBER ? v->number : fallback;
+    }
+    std::string string_or(const std::string& key, const std::string& fallback) const {
+        const JsonValue* v = get(key);
+        return v && v->type == STRING ? v->text : fallback;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& input) : s_(input) {}
+
+    bool parse(JsonValue& out) {
+        bool ok = value(out);
+        skip_space();
+        return ok && pos_ == s_.size();
+    }
+
+private:
+    void skip_space() {
+        while (pos_ < s_.size() && std::isspace(static_cast<unsigned char>(s_[pos_])))
+            pos_++;
+    }
+
+    bool literal(const char* word) {
+        size_t len = std::strlen(word);
+        if (s_.compare(pos_, len, word) != 0)
+            return false;
+        pos_ += len;
+        return true;
+    }
+
+    bool string(std::string& out) {
+        if (s_[pos_] != '"')
+            return false;
+        pos_++;
+        while (pos_ < s_.size() && s_[pos_] != '"') {
+            char c = s_[pos_++];
+            if (c == '\\' && pos_ < s_.size()) {
+                char e = s_[pos_++];
+                switch (e) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u':
+                    // Only ASCII escapes are ever written by json_escape().
+                    if (pos_ + 4 > s_.size())
+                        return false;
+                    out += static_cast<char>(std::strtol(s_.substr(pos_, 4).c_str(), nullptr, 16));
+                    pos_ += 4;
+                    break;
+                default: out += e; break;
+                }
+            } else {
+                out += c;
+            }
+        }
+        if (pos_ >= s_.size())
+            return false;
+        pos_++;
+        return true;
+    }
+
+    bool value(JsonValue& out) {
+        skip_space();
+        if (pos_ >= s_.size())
+            return false;
+        char c = s_[pos_];
+        if (c == '{') {
+            out.type = JsonValue::OBJECT;
+            pos_++;
+            skip_space();
+            if (pos_ < s_.size() && s_[pos_] == '}') {
+                pos_++;
+                return true;
+            }
+            for (;;) {
+                skip_space();
+                std::string key;
+                if (pos_ >= s_.size() || !string(key))
+                    return false;
+                skip_space();
+                if (pos_ >= s_.size() || s_[pos_++] != ':')
+                    return false;
+                if (!value(out.fields[key]))
+                    return false;
+                skip_space();
+                if (pos_ < s_.size() && s_[pos_] == ',') {
+                    pos_++;
+                    continue;
+                }
+                return pos_ < s_.size() && s_[pos_++] == '}';
+            }
+        }
+        if (c == '[') {
+            out.type = JsonValue::ARRAY;
+            pos_++;
+            skip_space();
+            if (pos_ < s_.size() && s_[pos_] == ']') {
+                pos_++;
+                return true;
+            }
+            for (;;) {
+                out.items.push_back(JsonValue());
+                if (!value(out.items.back()))
+                    return false;
+                skip_space();
+                if (pos_ < s_.size() && s_[pos_] == ',') {
+                    pos_++;
+                    continue;
+                }
+                return pos_ < s_.size() && s_[pos_++] == ']';
+            }
+        }
+        if (c == '"') {
+            out.type = JsonValue::STRING;
+            return string(out.text);
+        }
+        if (literal("true"))  { out.type = JsonValue::BOOL; out.boolean = true; return true; }
+        if (literal("false")) { out.type = JsonValue::BOOL; return true; }
+        if (literal("null"))  { out.type = JsonValue::NUL; return true; }
+
+        const char* start = s_.c_str() + pos_;
+        char* end;
+        out.number = std::strtod(start, &end);
+        if (end == start)
+            return false;
+        out.type = JsonValue::NUMBER;
+        pos_ += end - start;
+        return true;
+    }
+
+    const std::string& s_;
+    size_t pos_ = 0;
+};
+
+inline std::string json_escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                out += buffer;
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out;
+}
+
+inline std::string csv_escape(const std::string& text) {
+    if (text.find_first_of(",\"\n") == std::string::npos)
+        return text;
+    std::string out = "\"";
+    for (char c : text)
+        out += c == '"' ? std::string("\"\"") : std::string(1, c);
+    return out + "\"";
+}
+
+//------------------------//
+// Host metadata
+//------------------------//
+
+inline std::string compiler_description() {
+#if defined(__clang__)
+    return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+    return std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc " + std::to_string(_MSC_VER);
+#else
+    return "unknown";
+#endif
+}
+
+// The exact command line is only known when the build passes it in, e.g.
+// g++ -O2 -pthread -DBENCH_CFLAGS="\"-O2 -pthread\"" ...; otherwise report
+// what the predefined macros reveal.
+inline std::string compile_flags() {
+#ifdef BENCH_CFLAGS
+    return BENCH_CFLAGS;
+#else
+    std::string flags;
+#ifdef __OPTIMIZE__
+    flags += "optimized";
+#else
+    flags += "unoptimized";
+#endif
+#ifdef __AVX512F__
+    flags += ", baseline AVX-512";
+#elif defined(__AVX2__)
+    flags += ", baseline AVX2";
+#elif defined(__AVX__)
+    flags += ", baseline AVX";
+#else
+    flags += ", baseline SSE2";
+#endif
+#ifdef __FAST_MATH__
+    flags += ", fast-math";
+#endif
+    return flags;
+#endif
+}
+
+inline std::string kernel_description() {
+#ifdef __linux__
+    struct utsname name;
+    if (uname(&name) == 0)
+        return std::string(name.sysname) + " " + name.release + " " + name.machine;
+#elif defined(_WIN32)
+    return "Windows";
+#endif
+    return "unknown";
+}
+
+inline std::string host_name() {
+#ifdef __linux__
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) == 0)
+        return name;
+#endif
+    return "unknown";
+}
+
+inline std::string utc_timestamp() {
+    std::time_t now = std::time(nullptr);
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    return text;
+}
+
+//------------------------//
+// Report
+//------------------------//
+
+class BenchReport {
+public:
+    // Takes --json, --csv, --compare and --threshold out of argv.
+    void init(const char* program, int& argc, char** argv) {
+        program_ = program;
+        for (int i = 0; i < argc; i++)
+            command_ += (i ? " " : "") + std::string(argv[i]);
+        take_value_option(argc, argv, "--json", json_path_);
+        take_value_option(argc, argv, "--csv", csv_path_);
+        take_value_option(argc, argv, "--compare", baseline_path_);
+        std::string value;
+        if (take_value_option(argc, argv, "--threshold", value))
+            threshold_ = std::atof(value.c_str()) / 100.0;
+    }
+
+    void set_placement(const AffinityConfig& affinity, const std::vector<int>& cpus) {
+        placement_ = describe_affinity(affinity, cpus);
+        cpus_ = cpus;
+    }
+
+    void set_sampling(const MeasureConfig& config) { sampling_ = describe_measure_config(config); }
+
+    // A throughput: `work` units per sample divided by the sample times.
+    void add_rate(const std::string& benchmark, const ResultParams& params, const std::string& metric,
+                  const std::string& unit, const SampleStats& s, double work) {
+        ResultRecord r = base_record(benchmark, params, metric, unit, s);
+        r.higher_is_better = true;
+        r.value = work / s.median;
+        r.best = work / s.min;
+        r.mean = work / s.mean;
+        r.p95 = work / s.p95;
+        r.p99 = work / s.p99;
+        records_.push_back(r);
+    }
+
+    // A duration, each statistic multiplied by `scale` (e.g. 1e9 / loads for ns per load).
+    void add_time(const std::string& benchmark, const ResultParams& params, const std::string& metric,
+                  const std::string& unit, const SampleStats& s, double scale) {
+        ResultRecord r = base_record(benchmark, params, metric, unit, s);
+        r.higher_is_better = false;
+        r.value = s.median * scale;
+        r.best = s.min * scale;
+        r.mean = s.mean * scale;
+        r.p95 = s.p95 * scale;
+        r.p99 = s.p99 * scale;
+        records_.push_back(r);
+    }
+
+    // A derived figure without samples of its own (a ratio, a single estimate).
+    void add_value(const std::string& benchmark, const ResultParams& params, const std::string& metric,
+                   const std::string& unit, double value, bool higher_is_better) {
+        ResultRecord r;
+        r.benchmark = benchmark;
+        r.params = params;
+        r.metric = metric;
+        r.unit = unit;
+        r.higher_is_better = higher_is_better;
+        r.value = r.best = r.mean = r.p95 = r.p99 = value;
+        r.samples = 1;
+        records_.push_back(r);
+    }
+
+    // Cycles per operation and operations per cycle; `op` names the unit of work.
+    void add_cycles(const std::string& benchmark, const ResultParams& params, const CycleStats& c,
+                    const std::string& op) {
+        add_value(benchmark, params, "tsc_cycles_per_op", "cycles/" + op, c.tsc_per_op, false);
+        add_value(benchmark, params, "ops_per_tsc_cycle", op + "s/cycle", 1.0 / c.tsc_per_op, true);
+        if (c.core_per_op > 0) {
+            add_value(benchmark, params, "core_cycles_per_op", "cycles/" + op, c.core_per_op, false);
+            add_value(benchmark, params, "ops_per_core_cycle", op + "s/cycle", 1.0 / c.core_per_op, true);
+            add_value(benchmark, params, "core_clock", "GHz", c.core_ghz, true);
+        }
+    }
+
+    // IPC, stalled-cycle fraction and MPKI figures for whatever was counted.
+    void add_perf(const std::string& benchmark, const ResultParams& params, const PerfSample& s) {
+        if (s.has(PERF_CYCLES) && s.has(PERF_INSTRUCTIONS))
+            add_value(benchmark, params, "ipc", "instructions/cycle", s.ipc(), true);
+        if (s.has(PERF_STALLED_CYCLES) && s.has(PERF_CYCLES) && s[PERF_CYCLES] > 0)
+            add_value(benchmark, params, "stalled_cycles", "fraction", s[PERF_STALLED_CYCLES] / s[PERF_CYCLES], false);
+        if (!s.has(PERF_INSTRUCTIONS))
+            return;
+        const PerfCounter misses[] = { PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_DTLB_MISSES, PERF_BRANCH_MISSES };
+        const char* metrics[] = { "l1d_mpki", "llc_mpki", "dtlb_mpki", "branch_mpki" };
+        for (int i = 0; i < 4; i++)
+            if (s.has(misses[i]))
+                add_value(benchmark, params, metrics[i], "misses/kinstr", s.mpki(misses[i]), false);
+    }
+
+    const std::vector<ResultRecord>& records() const { return records_; }
+
+    void write_json(std::ostream& out) const {
+        const CpuInfo& cpu = cpu_info();
+        const CpuTopology& topology = cpu_topology();
+        out << std::setprecision(10);
+        out << "{\n  \"schema\": 1,\n"
+            << "  \"program\": \"" << json_escape(program_) << "\",\n"
+            << "  \"command\": \"" << json_escape(command_) << "\",\n"
+            << "  \"timestamp\": \"" << utc_timestamp() << "\",\n"
+            << "  \"host\": {\n"
+            << "    \"hostname\": \"" << json_escape(host_name()) << "\",\n"
+            << "    \"cpu\": \"" << json_escape(cpu.brand) << "\",\n"
+            << "    \"vendor\": \"" << json_escape(cpu.vendor) << "\",\n"
+            << "    \"family\": " << cpu.family << ",\n"
+            << "    \"model\": " << cpu.model << ",\n"
+            << "    \"stepping\": " << cpu.stepping << ",\n"
+            << "    \"features\": \"" << feature_list(cpu.features) << "\",\n"
+            << "    \"kernel\": \"" << json_escape(kernel_description()) << "\",\n"
+            << "    \"compiler\": \"" << json_escape(compiler_description()) << "\",\n"
+            << "    \"flags\": \"" << json_escape(compile_flags()) << "\",\n"
+            << "    \"placement\": \"" << json_escape(placement_) << "\",\n"
+            << "    \"pages\": \"" << PAGE_BACKEND_NAMES[page_backend()] << "\",\n"
+            << "    \"tsc_hz\": " << tsc_info().hz << ",\n"
+            << "    \"tsc_invariant\": " << (tsc_info().invariant ? "true" : "false") << ",\n"
+            << "    \"timer\": \"" << (use_tsc_timer() ? "rdtscp" : "steady_clock") << "\",\n"
+            << "    \"packages\": " << topology.packages << ",\n"
+            << "    \"physical_cores\": " << topology.physical_cores << ",\n"
+            << "    \"logical_cpus\": " << topology.cpus.size() << ",\n"
+            << "    \"numa_nodes\": " << topology.nodes.size() << ",\n"
+            << "    \"caches\": [";
+        for (size_t i = 0; i < topology.caches.size(); i++) {
+            const CacheLevel& c = topology.caches[i];
+            out << (i ? ", " : "") << "{\"level\": " << c.level << ", \"type\": \"" << json_escape(c.type)
+                << "\", \"size\": " << c.size << ", \"line\": " << c.line_size << ", \"ways\": " << c.ways
+                << ", \"shared_by\": " << c.sharing() << "}";
+        }
+        out << "],\n"
+            << "    \"cpus\": [";
+        for (size_t i = 0; i < cpus_.size(); i++)
+            out << (i ? ", " : "") << cpus_[i];
+        out << "]\n  },\n"
+            << "  \"sampling\": \"" << json_escape(sampling_) << "\",\n"
+            << "  \"results\": [";
+        for (size_t i = 0; i < records_.size(); i++) {
+            const ResultRecord& r = records_[i];
+            out << (i ? "," : "") << "\n    {\"id\": \"" << json_escape(r.id()) << "\", "
+                << "\"benchmark\": \"" << json_escape(r.benchmark) << "\", \"params\": {";
+            for (size_t p = 0; p < r.params.size(); p++)
+                out << (p ? ", " : "") << "\"" << json_escape(r.params[p].first) << "\": \""
+                    << json_escape(r.params[p].second) << "\"";
+            out << "}, \"metric\": \"" << json_escape(r.metric) << "\", \"unit\": \"" << json_escape(r.unit) << "\", "
+                << "\"higher_is_better\": " << (r.higher_is_better ? "true" : "false") << ", "
+                << "\"value\": " << r.value << ", \"best\": " << r.best << ", \"mean\": " << r.mean << ", "
+                << "\"p95\": " << r.p95 << ", \"p99\": " << r.p99 << ", "
+                << "\"rel_stddev\": " << r.rel_stddev << ", \"ci\": " << r.ci << ", "
+                << "\"samples\": " << r.samples << ", \"rejected\": " << r.rejected << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    // One row per metric; host columns repeat so files from many hosts concatenate.
+    void write_csv(std::ostream& out) const {
+        const CpuInfo& cpu = cpu_info();
+        std::string host = csv_escape(host_name()) + "," + csv_escape(cpu.brand) + "," +
+                           std::to_string(cpu.family) + "," + std::to_string(cpu.model) + "," +
+                           csv_escape(kernel_description()) + "," + csv_escape(compiler_description()) + "," +
+                           csv_escape(compile_flags()) + "," + csv_escape(placement_);
+        out << std::setprecision(10);
+        out << "hostname,cpu,family,model,kernel,compiler,flags,placement,program,benchmark,params,metric,unit,"
+               "higher_is_better,value,best,mean,p95,p99,rel_stddev,ci,samples,rejected\n";
+        for (const ResultRecord& r : records_) {
+            std::string params;
+            for (const auto& p : r.params)
+                params += (params.empty() ? "" : ";") + p.first + "=" + p.second;
+            out << host << "," << csv_escape(program_) << "," << csv_escape(r.benchmark) << ","
+                << csv_escape(params) << "," << csv_escape(r.metric) << "," << csv_escape(r.unit) << ","
+                << (r.higher_is_better ? 1 : 0) << "," << r.value << "," << r.best << "," << r.mean << ","
+                << r.p95 << "," << r.p99 << "," << r.rel_stddev << "," << r.ci << ","
+                << r.samples << "," << r.rejected << "\n";
+        }
+    }
+
+    // Writes the requested files and runs the baseline comparison. Returns
+    // `status` unless it is 0 and a regression was found (then 2).
+    int finish(int status) const {
+        if (!json_path_.empty() && !write_file(json_path_, true))
+            status = status ? status : 1;
+        if (!csv_path_.empty() && !write_file(csv_path_, false))
+            status = status ? status : 1;
+        if (!baseline_path_.empty()) {
+            int regressions = compare(baseline_path_);
+            if (regressions < 0)
+                status = status ? status : 1;
+            else if (regressions > 0)
+                status = status ? status : 2;
+        }
+        return status;
+    }
+
+private:
+    ResultRecord base_record(const std::string& benchmark, const ResultParams& params, const std::string& metric,
+                             const std::string& unit, const SampleStats& s) const {
+        ResultRecord r;
+        r.benchmark = benchmark;
+        r.params = params;
+        r.metric = metric;
+        r.unit = unit;
+        r.rel_stddev = s.mean > 0 ? s.stddev / s.mean : 0;
+        r.ci = s.ci;
+        r.samples = s.samples;
+        r.rejected = s.rejected;
+        return r;
+    }
+
+    bool write_file(const std::string& path, bool json) const {
+        if (path == "-") {
+            json ? write_json(std::cout) : write_csv(std::cout);
+            return true;
+        }
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "Cannot write " << path << "\n";
+            return false;
+        }
+        json ? write_json(file) : write_csv(file);
+        return true;
+    }
+
+    // Number of significant regressions, or -1 if the baseline can't be read.
+    int compare(const std::string& path) const {
+        std::ifstream file(path);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string text = buffer.str();
+        JsonValue root;
+        if (!file || !JsonParser(text).parse(root) || !root.get("results") ||
+            root.get("results")->type != JsonValue::ARRAY) {
+            std::cerr << "Cannot read baseline " << path << "\n";
+            return -1;
+        }
+
+        std::map<std::string, const JsonValue*> baseline;
+        for (const JsonValue& r : root.get("results")->items)
+            baseline[r.string_or("id", "")] = &r;
+
+        int regressions = 0, improvements = 0, changes = 0, unmatched = 0;
+        std::cout << "Comparison against " << path;
+        const JsonValue* host = root.get("host");
+        if (host)
+            std::cout << " (" << host->string_or("cpu", "?") << ", " << root.string_or("timestamp", "?") << ")";
+        std::cout << ", threshold " << threshold_ * 100 << "%\n";
+        std::cout << "-----------------------\n";
+
+        for (const ResultRecord& r : records_) {
+            auto it = baseline.find(r.id());
+            if (it == baseline.end()) {
+                unmatched++;
+                continue;
+            }
+            const JsonValue& b = *it->second;
+            double base = b.number_or("value", 0);
+            if (base == 0)
+                continue;
+            double change = (r.value - base) / base;
+            double worse = r.higher_is_better ? -change : change;
+
+            // Welch's t-test on the means, standard deviations from the relative spread.
+            // Single values can't be tested: report, don't gate.
+            int nb = static_cast<int>(b.number_or("samples", 1)), nc = r.samples;
+            if (nb <= 1 || nc <= 1) {
+                if (std::fabs(change) >= threshold_) {
+                    changes++;
+                    std::cout << "changed     " << r.id() << ": "
+                              << std::fixed << std::setprecision(2) << base << " -> " << r.value << " " << r.unit
+                              << " (" << std::showpos << 100.0 * change << std::noshowpos << "%)\n";
+                }
+                continue;
+            }
+            double sb = b.number_or("rel_stddev", 0) * b.number_or("mean", base);
+            double sc = r.rel_stddev * r.mean;
+            double se = std::sqrt(sb * sb / nb + sc * sc / nc);
+            double diff = std::fabs(r.mean - b.number_or("mean", base));
+            bool significant = diff > student_t95(std::min(nb, nc) - 1) * se;
+            if (std::fabs(change) < threshold_ || !significant)
+                continue;
+
+            bool regression = worse > 0;
+            regression ? regressions++ : improvements++;
+            std::cout << (regression ? "REGRESSION  " : "improvement ") << r.id() << ": "
+                      << std::fixed << std::setprecision(2) << base << " -> " << r.value << " " << r.unit
+                      << " (" << std::showpos << 100.0 * change << std::noshowpos << "%)\n";
+        }
+        std::cout << regressions << " regressions, " << improvements << " improvements";
+        if (changes)
+            std::cout << ", " << changes << " single values changed (not gated)";
+        if (unmatched)
+            std::cout << ", " << unmatched << " metrics not in the baseline";
+        std::cout << "\n-----------------------\n";
+        return regressions;
+    }
+
+    std::string program_, command_, placement_, sampling_;
+    std::vector<int> cpus_;
+    std::string json_path_, csv_path_, baseline_path_;
+    double threshold_ = 0.03;
+    std::vector<ResultRecord> records_;
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+// Repeated-measurement harness shared by the benchmarks. Every measurement
+// does a few untimed warmup runs (turbo ramp-up, page faults, cold caches),
+// then takes either a fixed number of samples or keeps sampling until the
+// 95% confidence interval of the mean is tight enough or the time box runs
+// out. Outliers are rejected by their distance from the median in units of
+// MAD before any statistic is computed. Samples are durations in seconds;
+// rates are derived from them only when printing.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_args.h"
+
+struct MeasureConfig {
+    int warmup = 1;            // untimed runs before sampling
+    int repetitions = 0;       // fixed sample count; 0 samples adaptively
+    int min_samples = 5;       // adaptive: never stop before this many
+    int max_samples = 50;      // adaptive: never take more than this many
+    double max_seconds = 2.0;  // adaptive: time box per measurement
+    double target_ci = 0.01;   // adaptive: stop when the CI half-width is within this fraction of the mean
+    double outlier_mad = 3.5;  // reject |x - median| > k * 1.4826 * MAD; 0 keeps everything
+};
+
+struct SampleStats {
+    int samples = 0;   // kept after outlier rejection
+    int rejected = 0;
+    double min = 0, max = 0, median = 0, mean = 0, stddev = 0, p95 = 0, p99 = 0;
+    double ci = 0;     // half-width of the 95% CI of the mean, relative to the mean
+    int runs = 0;              // every run() call, warmup and rejected samples included
+    double total_seconds = 0;  // their summed durations
+};
+
+// Two-sided 95% Student t quantile for `df` degrees of freedom.
+inline double student_t95(int df) {
+    static const double table[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    if (df < 1)
+        return table[0];
+    return df <= 30 ? table[df - 1] : 1.96 + 2.4 / df;
+}
+
+// Linear interpolation between closest ranks; `sorted` must be non-empty.
+inline double percentile(const std::vector<double>& sorted, double q) {
+    double rank = q * (sorted.size() - 1);
+    size_t low = static_cast<size_t>(rank);
+    size_t high = std::min(low + 1, sorted.size() - 1);
+    return sorted[low] + (rank - low) * (sorted[high] - sorted[low]);
+}
+
+inline SampleStats summarize(std::vector<double> samples, double outlier_mad) {
+    SampleStats s;
+    if (samples.empty())
+        return s;
+
+    std::sort(samples.begin(), samples.end());
+    if (outlier_mad > 0 && samples.size() >= 3) {
+        double median = percentile(samples, 0.5);
+        std::vector<double> deviation;
+        for (double x : samples)
+            deviation.push_back(std::fabs(x - median));
+        std::sort(deviation.begin(), deviation.end());
+        double limit = outlier_mad * 1.4826 * percentile(deviation, 0.5);
+        if (limit > 0) {
+            std::vector<double> kept;
+            for (double x : samples)
+                if (std::fabs(x - median) <= limit)
+                    kept.push_back(x);
+            s.rejected = static_cast<int>(samples.size() - kept.size());
+            samples.swap(kept);
+        }
+    }
+
+    s.samples = static_cast<int>(samples.size());
+    s.min = samples.front();
+    s.max = samples.back();
+    s.median = percentile(samples, 0.5);
+    s.p95 = percentile(samples, 0.95);
+    s.p99 = percentile(samples, 0.99);
+    double sum = 0.0;
+    for (double x : samples)
+        sum += x;
+    s.mean = sum / samples.size();
+    double squares = 0.0;
+    for (double x : samples)
+        squares += (x - s.mean) * (x - s.mean);
+    if (samples.size() > 1) {
+        s.stddev = std::sqrt(squares / (samples.size() - 1));
+        s.ci = student_t95(s.samples - 1) * s.stddev / std::sqrt(double(s.samples)) / s.mean;
+    }
+    return s;
+}
+
+// Calls run() (which returns the seconds one sample took) according to
+// `config` and summarizes the samples.
+template <typename Run>
+SampleStats measure(const MeasureConfig& config, Run run) {
+    double warmup_seconds = 0;
+    for (int i = 0; i < config.warmup; i++)
+        warmup_seconds += run();
+
+    std::vector<double> samples;
+    auto finish = [&](SampleStats stats) {
+        stats.runs = config.warmup + static_cast<int>(samples.size());
+        stats.total_seconds = warmup_seconds;
+        for (double x : samples)
+            stats.total_seconds += x;
+        return stats;
+    };
+
+    if (config.repetitions > 0) {
+        for (int i = 0; i < config.repetitions; i++)
+            samples.push_back(run());
+        return finish(summarize(samples, config.outlier_mad));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        samples.push_back(run());
+        int count = static_cast<int>(samples.size());
+        if (count < config.min_samples)
+            continue;
+        SampleStats stats = summarize(samples, config.outlier_mad);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (stats.ci <= config.target_ci || count >= config.max_samples || elapsed >= config.max_seconds)
+            return finish(stats);
+    }
+}
+
+// Every statistic multiplied by `factor`, e.g. seconds per run to ns per operation.
+inline SampleStats scale_stats(SampleStats s, double factor) {
+    s.min *= factor;
+    s.max *= factor;
+    s.median *= factor;
+    s.mean *= factor;
+    s.stddev *= factor;
+    s.p95 *= factor;
+    s.p99 *= factor;
+    return s;
+}
+
+// "--warmup=N --reps=N --min-reps=N --max-reps=N --max-time=S --ci=PCT --outliers=K";
+// --reps switches from adaptive to a fixed sample count.
+inline void measure_config_from_args(int& argc, char** argv, MeasureConfig& config) {
+    std::string value;
+    if (take_option(argc, argv, "--warmup", value))   config.warmup = std::atoi(value.c_str());
+    if (take_option(argc, argv, "--reps", value))     config.repetitions = std::atoi(value.c_str());
+    if (take_option(argc, argv, "--min-reps", value)) config.min_samples = std::max(1, std::atoi(value.c_str()));
+    if (take_option(argc, argv, "--max-reps", value)) config.max_samples = std::max(1, std::atoi(value.c_str()));
+    if (take_option(argc, argv, "--max-time", value)) config.max_seconds = std::atof(value.c_str());
+    if (take_option(argc, argv, "--ci", value))       config.target_ci = std::atof(value.c_str()) / 100.0;
+    if (take_option(argc, argv, "--outliers", value)) config.outlier_mad = std::atof(value.c_str());
+    config.max_samples = std::max(config.max_samples, config.min_samples);
+}
+
+inline std::string describe_measure_config(const MeasureConfig& config) {
+    std::ostringstream text;
+    text << "Sampling: " << config.warmup << " warmup, ";
+    if (config.repetitions > 0)
+        text << config.repetitions << " samples";
+    else
+        text << config.min_samples << "-" << config.max_samples << " samples until 95% CI within +/-"
+             << config.target_ci * 100 << "% or " << config.max_seconds << " s";
+    if (config.outlier_mad > 0)
+        text << ", outliers beyond " << config.outlier_mad << " MAD rejected";
+    return text.str();
+}
+
+// ", sd x%, CI +/-y%, n=N, k outliers)" closing both summaries below.
+inline void append_spread(std::ostringstream& text, const SampleStats& s) {
+    text.precision(1);
+    text << ", sd " << 100.0 * s.stddev / s.mean << "%, CI +/-" << 100.0 * s.ci << "%, n=" << s.samples;
+    if (s.rejected)
+        text << ", " << s.rejected << " outlier" << (s.rejected > 1 ? "s" : "");
+    text << ")";
+}
+
+// One-line summary of a rate, `work` units per sample divided by the sample
+// times: the median rate first, then the best run, the mean, and the rates
+// that 95% / 99% of runs reached (from the p95 / p99 times).
+inline std::string format_rate_stats(const SampleStats& s, double work, int precision = 2) {
+    std::ostringstream text;
+    text.setf(std::ios::fixed);
+    text.precision(precision);
+    text << work / s.median << " (best " << work / s.min << ", mean " << work / s.mean
+         << ", p95 " << work / s.p95 << ", p99 " << work / s.p99;
+    append_spread(text, s);
+    return text.str();
+}
+
+// Same for a duration, each statistic multiplied by `scale` (e.g. 1e9 / loads for ns per load).
+inline std::string format_time_stats(const SampleStats& s, double scale, int precision = 2) {
+    std::ostringstream text;
+    text.setf(std::ios::fixed);
+    text.precision(precision);
+    text << s.median * scale << " (min " << s.min * scale << ", mean " << s.mean * scale
+         << ", p95 " << s.p95 * scale << ", p99 " << s.p99 * scale;
+    append_spread(text, s);
+    return text.str();
+}
@@ -0,0 +1,319 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <immintrin.h>
+
+#include "affinity.h"
+#include "bench_args.h"
+#include "bench_report.h"
+#include "bench_stats.h"
+#include "cpu_clock.h"
+#include "cpu_info.h"
+#include "cpu_topology.h"
+#include "worker_pool.h"
+
+std::vector<int> thread_cpus; // CPU for worker 0, from --affinity
+MeasureConfig measure_config; // warmup and repetitions, from --warmup/--reps/...
+BenchReport report; // --json/--csv/--compare
+
+const size_t BYTES_PER_SAMPLE = 16ULL << 20; // small sizes repeat until a sample moves this much,
+const size_t MAX_CALLS = 100000;             // or makes this many calls
+
+//------------------------//
+// Copy and fill variants
+//------------------------//
+
+typedef void (*CopyFunc)(char* dst, const char* src, size_t n);
+typedef void (*FillFunc)(char* dst, int value, size_t n);
+
+void copy_std(char* dst, const char* src, size_t n) {
+    std::memcpy(dst, src, n);
+}
+
+void fill_std(char* dst, int value, size_t n) {
+    std::memset(dst, value, n);
+}
+
+// Microcoded string moves: fast for large sizes with ERMS, and for short
+// ones too with FSRM.
+void copy_rep_movsb(char* dst, const char* src, size_t n) {
+    __asm__ volatile ("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) :: "memory");
+}
+
+void fill_rep_stosb(char* dst, int value, size_t n) {
+    __asm__ volatile ("rep stosb" : "+D"(dst), "+c"(n) : "a"(value) : "memory");
+}
+
+// Sizes below one vector: 8 bytes, then single bytes.
+inline void copy_short(char* dst, const char* src, size_t n) {
+    for (; n >= 8; n -= 8, dst += 8, src += 8) {
+        uint64_t word;
+        std::memcpy(&word, src, 8);
+        std::memcpy(dst, &word, 8);
+    }
+    for (; n; n--)
+        *dst++ = *src++;
+}
+
+inline void fill_short(char* dst, int value, size_t n) {
+    uint64_t word = 0x0101010101010101ULL * uint8_t(value);
+    for (; n >= 8; n -= 8, dst += 8)
+        std::memcpy(dst, &word, 8);
+    for (; n; n--)
+        *dst++ = char(value);
+}
+
+// The vector loops, stamped per ISA: one unaligned vector for the head,
+// then aligned stores (streaming ones with NT) four vectors at a time,
+// then an unaligned vector ending exactly at the last byte, overlapping
+// what is already written. NT stores are fenced before returning.
+#define DEFINE_COPY_KERNELS(suffix, isa, vec_t, width, load, store, store_aligned, stream, set1)   \
+    template <bool NT>                                                                           \
+    isa inline void store_##suffix(char* p, vec_t v) {                                           \
+        if (NT) stream(reinterpret_cast<vec_t*>(p), v);                                          \
+        else    store_aligned(reinterpret_cast<vec_t*>(p), v);                                   \
+    }                                                                                            \
+                                                                                                 \
+    template <bool NT>                                                                           \
+    isa void copy_##suffix(char* dst, const char* src, size_t n) {                               \
+        if (n < width) {                                                                         \
+            copy_short(dst, src, n);                                                             \
+            return;                                                                              \
+        }                                                                                        \
+        vec_t last = load(reinterpret_cast<const vec_t*>(src + n - width));                      \
+        char* end = dst + n;                                                                     \
+        store(reinterpret_cast<vec_t*>(dst), load(reinterpret_cast<const vec_t*>(src)));         \
+        size_t head = width - (reinterpret_cast<uintptr_t>(dst) & (width - 1));                  \
+        dst += head;                                                                             \
+        src += head;                                                                             \
+        for (; dst + 4 * width <= end; dst += 4 * width, src += 4 * width) {                     \
+            vec_t a = load(reinterpret_cast<const vec_t*>(src));                                 \
+            vec_t b = load(reinterpret_cast<const vec_t*>(src + width));                         \
+            vec_t c = load(reinterpret_cast<const vec_t*>(src + 2 * width));                     \
+            vec_t d = load(reinterpret_cast<const vec_t*>(src + 3 * width));                     \
+            store_##suffix<NT>(dst, a);                                                          \
+            store_##suffix<NT>(dst + width, b);                                                  \
+            store_##suffix<NT>(dst + 2 * width, c);                                              \
+            store_##suffix<NT>(dst + 3 * width, d);                                              \
+        }                                                                                        \
+        for (; dst + width <= end; dst += width, src += width)                                   \
+            store_##suffix<NT>(dst, load(reinterpret_cast<const vec_t*>(src)));                  \
+        if (NT)                                                                                  \
+            _mm_sfence();                                                                        \
+        store(reinterpret_cast<vec_t*>(end - width), last);                                      \
+    }                                                                                            \
+                                                                                                 \
+    template <bool NT>                                                                           \
+    isa void fill_##suffix(char* dst, int value, size_t n) {                                     \
+        if (n < width) {                                                                         \
+            fill_short(dst, value, n);                                                           \
+            return;                                                                              \
+        }                                                                                        \
+        vec_t v = set1(char(value));                                                             \
+        char* end = dst + n;                                                                     \
+        store(reinterpret_cast<vec_t*>(dst), v);                                                 \
+        dst += width - (reinterpret_cast<uintptr_t>(dst) & (width - 1));                         \
+        for (; dst + 4 * width <= end; dst += 4 * width) {                                       \
+            store_##suffix<NT>(dst, v);                                                          \
+            store_##suffix<NT>(dst + width, v);                                                  \
+            store_##suffix<NT>(dst + 2 * width, v);                                              \
+            store_##suffix<NT>(dst + 3 * width, v);                                              \
+        }                                                                                        \
+        for (; dst + width <= end; dst += width)                                                 \
+            store_##suffix<NT>(dst, v);                                                          \
+        if (NT)                                                                                  \
+            _mm_sfence();                                                                        \
+        store(reinterpret_cast<vec_t*>(end - width), v);                                         \
+    }
+
+DEFINE_COPY_KERNELS(sse, , __m128i, 16, _mm_loadu_si128, _mm_storeu_si128, _mm_store_si128,
+                    _mm_stream_si128, _mm_set1_epi8)
+DEFINE_COPY_KERNELS(avx, ISA_AVX, __m256i, 32, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_store_si256,
+                    _mm256_stream_si256, _mm256_set1_epi8)
+DEFINE_COPY_KERNELS(avx512, ISA_AVX512, __m512i, 64, _mm512_loadu_si512, _mm512_storeu_si512,
+                    _mm512_store_si512, _mm512_stream_si512, _mm512_set1_epi8)
+
+struct CopyVariant {
+    const char* name;
+    FeatureMask required;
+    CopyFunc copy;
+    FillFunc fill;
+};
+
+// rep movsb/stosb run everywhere; ERMS and FSRM only make them fast, and
+// the header says which this host has.
+const CopyVariant COPY_VARIANTS[] = {
+    { "std",        0,            copy_std,              fill_std },
+    { "rep",        0,            copy_rep_movsb,        fill_rep_stosb },
+    { "SSE",        0,            copy_sse<false>,       fill_sse<false> },
+    { "SSE NT",     0,            copy_sse<true>,        fill_sse<true> },
+    { "AVX",        NEEDS_AVX,    copy_avx<false>,       fill_avx<false> },
+    { "AVX NT",     NEEDS_AVX,    copy_avx<true>,        fill_avx<true> },
+    { "AVX-512",    NEEDS_AVX512, copy_avx512<false>,    fill_avx512<false> },
+    { "AVX-512 NT", NEEDS_AVX512, copy_avx512<true>,     fill_avx512<true> },
+};
+
+//------------------------//
+// Size and alignment sweep
+//------------------------//
+
+// Source and destination offsets from a page boundary.
+struct Misalignment {
+    size_t src, dst;
+};
+
+const Misalignment MISALIGNMENTS[] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 7, 13 } };
+
+// Seconds per call of copy (or fill when `src` is null) at `n` bytes,
+// repeated within each sample so small sizes still give a timed region.
+// Repeats run on the same buffers, so sizes that fit a cache measure
+// cache-hot calls, as on a hot path.
+SampleStats measure_call(const CopyVariant& v, char* dst, const char* src, size_t n) {
+    size_t reps = std::max<size_t>(1, std::min(BYTES_PER_SAMPLE / n, MAX_CALLS));
+    SampleStats stats = measure(measure_config, [&] {
+        uint64_t start = timer_begin();
+        if (src)
+            for (size_t r = 0; r < reps; r++)
+                v.copy(dst, src, n);
+        else
+            for (size_t r = 0; r < reps; r++)
+                v.fill(dst, r & 0xff, n);
+        __asm__ volatile ("" ::: "memory");
+        return timer_seconds(timer_end() - start);
+    });
+    return scale_stats(stats, 1.0 / reps);
+}
+
+// One table per operation and misalignment: median GB/s for every variant
+// and size from 8 B up to `max_size` in powers of two, the winner of each
+// row, then the crossovers, the sizes from which another variant wins.
+int run_copy_sweep(size_t max_size) {
+    pin_current_thread(thread_cpus[0]);
+    std::vector<CopyVariant> variants = supported_entries(COPY_VARIANTS);
+    size_t mapping = max_size + 4096;
+    char* src = map_pages(mapping, page_backend());
+    char* dst = map_pages(mapping, page_backend());
+    if (!src || !dst) {
+        std::cerr << "Cannot map " << format_size(mapping) << " twice\n";
+        return 1;
+    }
+    // Touch both buffers so no size reads the shared zero page.
+    std::memset(src, 1, mapping);
+    std::memset(dst, 0, mapping);
+
+    std::vector<size_t> sizes;
+    for (size_t n = 8; n <= max_size; n *= 2)
+        sizes.push_back(n);
+
+    for (int fill = 0; fill <= 1; fill++) {
+        const char* op = fill ? "fill" : "copy";
+        for (const Misalignment& m : MISALIGNMENTS) {
+            if (fill && m.src != 0)
+                continue; // a fill has no source
+            std::cout << "-----------------------\n";
+            std::cout << (fill ? "memset-style fill" : "memcpy-style copy") << ", destination offset " << m.dst;
+            if (!fill)
+                std::cout << ", source offset " << m.src;
+            std::cout << ", median GB/s\n";
+            std::cout << std::setw(10) << "Size" << std::setw(6) << "Fits";
+            for (const CopyVariant& v : variants)
+                std::cout << std::setw(11) << v.name;
+            std::cout << std::setw(12) << "Best" << "\n" << std::fixed << std::setprecision(2);
+
+            std::string align = std::to_string(m.src) + "/" + std::to_string(m.dst);
+            std::vector<size_t> winners;
+            for (size_t n : sizes) {
+                std::cout << std::setw(10) << format_size(n) << std::setw(6)
+                          << cpu_topology().fitting_level(fill ? n : 2 * n, 1);
+                size_t best = 0;
+                double best_rate = 0;
+                for (size_t i = 0; i < variants.size(); i++) {
+                    const CopyVariant& v = variants[i];
+                    SampleStats stats = measure_call(v, dst + m.dst, fill ? nullptr : src + m.src, n);
+                    double gb = n / (1024.0 * 1024.0 * 1024.0);
+                    double rate = gb / stats.median;
+                    ResultParams params = {{"op", op}, {"variant", v.name}, {"size", format_size(n)},
+                                           {"align", align}};
+                    report.add_rate("copy", params, "bandwidth", "GB/s", stats, gb);
+                    report.add_time("copy", params, "call_time", "ns", stats, 1e9);
+                    if (rate > best_rate) {
+                        best_rate = rate;
+                        best = i;
+                    }
+                    std::cout << std::setw(11) << rate;
+                }
+                std::cout << std::setw(12) << variants[best].name << "\n";
+                winners.push_back(best);
+            }
+
+            // Where each winner takes over. A single value, so --compare
+            // lists a moved crossover without counting it as a regression.
+            std::vector<std::string> crossovers;
+            for (size_t s = 0; s < sizes.size(); s++) {
+                if (s > 0 && winners[s] == winners[s - 1])
+                    continue;
+                crossovers.push_back(std::string(s == 0 ? "from " : "then from ") + format_size(sizes[s]) + " " +
+                                     variants[winners[s]].name);
+                // Keyed on the size as well: a variant can win several ranges.
+                report.add_value("copy", {{"op", op}, {"align", align}, {"from", format_size(sizes[s])},
+                                          {"variant", variants[winners[s]].name}},
+                                 "wins_from", "B", sizes[s], false);
+            }
+            std::cout << "Crossovers:";
+            for (size_t c = 0; c < crossovers.size(); c++)
+                std::cout << (c ? ", " : " ") << crossovers[c];
+            std::cout << "\n";
+        }
+    }
+
+    unmap_pages(src, mapping, page_backend());
+    unmap_pages(dst, mapping, page_backend());
+    return 0;
+}
+
+// Usage: copy_bench [max MiB]    copy and fill from 8 B to max MiB (default 1 GiB, at most an
+//                                eighth of memory) with std::memcpy/memset, rep movsb/stosb and
+//                                SSE/AVX/AVX-512 loops with and without NT stores, at several
+//                                source/destination misalignments; one thread
+// Options: --affinity=scatter|compact|physical|<cpu list> (first CPU is used)
+//          --pages=default|nothp|thp|2m|1g for both buffers
+//          --warmup=N --reps=N | --min-reps=N --max-reps=N --max-time=S --ci=PCT, --outliers=K
+//          --json=FILE --csv=FILE --compare=BASELINE.json --threshold=PCT, --timer=tsc|steady
+int main(int argc, char** argv) {
+    report.init("copy_bench", argc, argv);
+    AffinityConfig affinity;
+    thread_cpus = affinity_from_args(argc, argv, affinity);
+    thread_cpus.resize(1);
+    pages_from_args(argc, argv);
+    // Hundreds of size/variant points: a shorter time box than the default.
+    measure_config.max_seconds = 0.25;
+    measure_config_from_args(argc, argv, measure_config);
+    timer_from_args(argc, argv);
+    report.set_placement(affinity, thread_cpus);
+    report.set_sampling(measure_config);
+
+    size_t max_size = 1ULL << 30;
+    if (cpu_topology().memory_bytes)
+        while (max_size > (1ULL << 20) && max_size > cpu_topology().memory_bytes / 8)
+            max_size /= 2;
+    if (argc > 1)
+        max_size = std::stoull(argv[1]) * 1024 * 1024;
+
+    const CpuInfo& cpu = cpu_info();
+    std::cout << "CPU: " << cpu.brand << "\n";
+    std::cout << "String moves: ERMS " << (cpu.has(CPU_ERMS) ? "yes" : "no") << ", FSRM "
+              << (cpu.has(CPU_FSRM) ? "yes" : "no") << "\n";
+    std::cout << describe_measure_config(measure_config) << "\n";
+    std::cout << describe_timer() << "\n";
+    std::cout << describe_topology(cpu_topology()) << "\n";
+    std::cout << describe_affinity(affinity, thread_cpus) << "\n";
+    std::cout << describe_pages(page_backend()) << "\n";
+    report.add_value("copy", {}, "erms", "flag", cpu.has(CPU_ERMS), true);
+    report.add_value("copy", {}, "fsrm", "flag", cpu.has(CPU_FSRM), true);
+
+    return report.finish(run_copy_sweep(max_size));
+}
@@ -7,62 +7,78 @@
 #include <vector>
 #include <algorithm>
 
+#include "affinity.h"
+#include "bench_report.h"
+#include "bench_stats.h"
+#include "cpu_clock.h"
+#include "worker_pool.h"
+
 // Number of operations per thread and threads
     constexpr uint64_t OP_COUNT = 1E9; // Adjust as needed
     unsigned NUM_THREADS = std::thread::hardware_concurrency();
+    std::vector<int> thread_cpus; // CPU for worker i, from --affinity
+    BenchReport report; // --json/--csv/--compare
 
-// Template function to perform operations based on data type
+// Template function to perform operations based on data type.
+// Timing is done by the worker pool around each call.
 template <typename T>
-void perform_operations(const char* type_name, double& thread_time, uint64_t ops) {
+void perform_operations(const char* type_name, uint64_t ops) {
     volatile T op_counter = 0;
-    auto start = std::chrono::high_resolution_clock::now();
 
     for (uint64_t i = 0; i < ops; ++i) {
         ++op_counter;  // Increment operation counter (dummy operation)
     }
-
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end - start;
-
-    thread_time = elapsed.count();
 }
 
-int main() {
-    std::vector<std::thread> threads;
-    std::vector<double> thread_times(NUM_THREADS); // Store individual thread times
+// Usage: cpu_bench [--affinity=scatter|compact|physical|none|<cpu list>]
+//                  [--warmup=N] [--reps=N | --min-reps=N --max-reps=N --max-time=S --ci=PCT] [--outliers=K]
+//                  [--json=FILE] [--csv=FILE] [--compare=BASELINE.json] [--threshold=PCT] [--timer=tsc|steady]
+int main(int argc, char** argv) {
+    report.init("cpu_bench", argc, argv);
+    AffinityConfig affinity;
+    thread_cpus = affinity_from_args(argc, argv, affinity);
+    NUM_THREADS = thread_cpus.size();
+    timer_from_args(argc, argv);
+    // Each run is a second or more here, so sample less than the default
+    MeasureConfig config;
+    config.min_samples = 3;
+    config.max_samples = 10;
+    config.max_seconds = 10.0;
+    measure_config_from_args(argc, argv, config);
+    report.set_placement(affinity, thread_cpus);
+    report.set_sampling(config);
+    WorkerPool pool(thread_cpus);
 
     auto benchmark = [&](const char* type_name, auto data_type) {
-        // Single-threaded benchmark
-        double single_thread_time;
-        perform_operations<decltype(data_type)>(type_name, single_thread_time, OP_COUNT);
-        double single_thread_ops_per_sec = OP_COUNT / single_thread_time;
-
-        // Multi-threaded benchmark
-        for (unsigned i = 0; i < NUM_THREADS; ++i) {
-            threads.emplace_back([&, i] {
-                perform_operations<decltype(data_type)>(type_name, thread_times[i], OP_COUNT);
-            });
-        }
+        auto operations = [&](int) { perform_operations<decltype(data_type)>(type_name, OP_COUNT); };
 
-        for (auto& t : threads) {
-            if (t.joinable()) {
-                t.join();
-            }
-        }
+        // Single-threaded benchmark
+        SampleStats single_thread = measure(config, [&] { return pool.run(1, operations); });
 
-        threads.clear(); // Clear threads vector for the next benchmark run
+        // Multi-threaded benchmark: all workers start together, time spans first start to last finish
+        SampleStats multi_thread = measure(config, [&] { return pool.run(NUM_THREADS, operations); });
 
-        // Calculate the max time taken by any thread for this data type
-        double max_time = *std::max_element(thread_times.begin(), thread_times.end());
-        double multi_thread_ops_per_sec = (OP_COUNT * NUM_THREADS) / max_time;
+        // With one worker both runs are threads=1: record the single-thread run only
+        report.add_rate("ops", {{"type", type_name}, {"threads", "1"}}, "throughput", "GOP/s",
+                        single_thread, OP_COUNT / 1E9);
+        if (NUM_THREADS > 1)
+            report.add_rate("ops", {{"type", type_name}, {"threads", std::to_string(NUM_THREADS)}}, "throughput", "GOP/s",
+                            multi_thread, OP_COUNT * NUM_THREADS / 1E9);
 
-        // Calculate the single to multi-thread ratio
-        double ratio = multi_thread_ops_per_sec / single_thread_ops_per_sec;
+        // Calculate the single to multi-thread ratio from the median rates
+        double ratio = NUM_THREADS * single_thread.median / multi_thread.median;
 
         // Print results
         std::cout << "Type: " << type_name << "\n";
-        std::cout << "Single Thread: " << single_thread_ops_per_sec << " GOPs\n";
-        std::cout << "Multi Thread: " << multi_thread_ops_per_sec << " GOPs\n";
+        std::cout << "Single Thread: " << format_rate_stats(single_thread, OP_COUNT / 1E9) << " GOPs\n";
+        std::cout << "Multi Thread: " << format_rate_stats(multi_thread, OP_COUNT * NUM_THREADS / 1E9) << " GOPs\n";
+        CycleStats single_cycles = cycle_stats(single_thread, PerfSample(), OP_COUNT, 1);
+        CycleStats multi_cycles = cycle_stats(multi_thread, PerfSample(), OP_COUNT, NUM_THREADS);
+        std::cout << "Single Thread: " << format_cycles(single_cycles, "op") << "\n";
+        std::cout << "Multi Thread: " << format_cycles(multi_cycles, "op") << " per thread\n";
+        report.add_cycles("ops", {{"type", type_name}, {"threads", "1"}}, single_cycles, "op");
+        if (NUM_THREADS > 1)
+            report.add_cycles("ops", {{"type", type_name}, {"threads", std::to_string(NUM_THREADS)}}, multi_cycles, "op");
         std::cout << "Single to Multi Ratio: " << ratio << "\n";
         std::cout << "-----------------------\n";
     };
@@ -70,6 +86,9 @@ int main() {
     // Benchmark operations for different data types
 
     std::cout << "G Operations: " << OP_COUNT/(1E9) << "\n";
+    std::cout << describe_measure_config(config) << "\n";
+    std::cout << describe_timer() << "\n";
+    std::cout << describe_affinity(affinity, thread_cpus) << "\n";
     std::cout << "-----------------------\n";
     benchmark("double", double());
     benchmark("float", float());
@@ -77,5 +96,5 @@ int main() {
     benchmark("int32_t", int32_t());
     benchmark("int8_t", int8_t());
 
-    return 0;
+    return report.finish(0);
 }
@@ -1,148 +1,699 @@
-#pragma GCC optimize ("O0")
-
 #include <iostream>
+#include <iomanip>
 #include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <string>
 #include <thread>
 #include <vector>
 #include <algorithm>
 #include <immintrin.h>
-#include <malloc.h>
 
-constexpr uint64_t OP_COUNT = 1000000000;
+#include "affinity.h"
+#include "bench_args.h"
+#include "bench_report.h"
+#include "bench_stats.h"
+#include "cpu_clock.h"
+#include "cpu_info.h"
+#include "perf_counters.h"
+#include "worker_pool.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+constexpr uint64_t OP_COUNT = 1000000000; // vector instructions per thread per kernel
 unsigned NUM_THREADS = std::thread::hardware_concurrency();
+std::vector<int> thread_cpus; // CPU for worker i, from --affinity
+BenchReport report; // --json/--csv/--compare
+PoolCounters perf;  // per-worker hardware counters, when permitted
+
+//------------------------//
+// Operations
+//------------------------//
+
+// One instruction at one vector width and element type. `lanes` is elements
+// per register, `flops` floating-point operations per lane (0 for integer).
+// apply() computes the next accumulator value from the previous one.
+#define PEAK_OP(name, isa, vec_t, lanes_n, flops_n, set1_expr, apply_expr)  \
+    struct name {                                                           \
+        typedef vec_t vec;                                                  \
+        static const int lanes = lanes_n;                                   \
+        static const int flops = flops_n;                                   \
+        isa static vec set1(double v) { return set1_expr; }                 \
+        isa static vec apply(vec acc, vec x, vec y) { (void)x; (void)y; return apply_expr; } \
+    };
+
+// SSE2 is the x86-64 baseline, so these need no target; only pmulld
+// (SSE4.1) gets one.
+PEAK_OP(scalar_add_f64,   ,          __m128d, 1, 1, _mm_set1_pd(v), _mm_add_sd(acc, y))
+PEAK_OP(scalar_mul_f64,   ,          __m128d, 1, 1, _mm_set1_pd(v), _mm_mul_sd(acc, x))
+PEAK_OP(scalar_fma_f64,   ISA_FMA, __m128d, 1, 2, _mm_set1_pd(v), _mm_fmadd_sd(acc, x, y))
+
+PEAK_OP(sse_add_f32,      ,          __m128,  4, 1, _mm_set1_ps(float(v)), _mm_add_ps(acc, y))
+PEAK_OP(sse_mul_f32,      ,          __m128,  4, 1, _mm_set1_ps(float(v)), _mm_mul_ps(acc, x))
+PEAK_OP(sse_add_f64,      ,          __m128d, 2, 1, _mm_set1_pd(v), _mm_add_pd(acc, y))
+PEAK_OP(sse_mul_f64,      ,          __m128d, 2, 1, _mm_set1_pd(v), _mm_mul_pd(acc, x))
+PEAK_OP(sse_add_i32,      ,          __m128i, 4, 0, _mm_set1_epi32(int(v)), _mm_add_epi32(acc, y))
+PEAK_OP(sse_mullo_i32,    ISA_SSE42, __m128i, 4, 0, _mm_set1_epi32(int(v)), _mm_mullo_epi32(acc, x))
+PEAK_OP(sse_add_i64,      ,          __m128i, 2, 0, _mm_set1_epi64x((long long)v), _mm_add_epi64(acc, y))
+
+PEAK_OP(avx_add_f32,      ISA_AVX, __m256,  8, 1, _mm256_set1_ps(float(v)), _mm256_add_ps(acc, y))
+PEAK_OP(avx_mul_f32,      ISA_AVX, __m256,  8, 1, _mm256_set1_ps(float(v)), _mm256_mul_ps(acc, x))
+PEAK_OP(avx_add_f64,      ISA_AVX, __m256d, 4, 1, _mm256_set1_pd(v), _mm256_add_pd(acc, y))
+PEAK_OP(avx_mul_f64,      ISA_AVX, __m256d, 4, 1, _mm256_set1_pd(v), _mm256_mul_pd(acc, x))
+
+PEAK_OP(fma128_f32,       ISA_FMA, __m128,  4, 2, _mm_set1_ps(float(v)), _mm_fmadd_ps(acc, x, y))
+PEAK_OP(fma128_f64,       ISA_FMA, __m128d, 2, 2, _mm_set1_pd(v), _mm_fmadd_pd(acc, x, y))
+PEAK_OP(fma256_f32,       ISA_FMA, __m256,  8, 2, _mm256_set1_ps(float(v)), _mm256_fmadd_ps(acc, x, y))
+PEAK_OP(fma256_f64,       ISA_FMA, __m256d, 4, 2, _mm256_set1_pd(v), _mm256_fmadd_pd(acc, x, y))
+
+PEAK_OP(avx2_add_i32,     ISA_AVX2, __m256i, 8, 0, _mm256_set1_epi32(int(v)), _mm256_add_epi32(acc, y))
+PEAK_OP(avx2_mullo_i32,   ISA_AVX2, __m256i, 8, 0, _mm256_set1_epi32(int(v)), _mm256_mullo_epi32(acc, x))
+PEAK_OP(avx2_add_i64,     ISA_AVX2, __m256i, 4, 0, _mm256_set1_epi64x((long long)v), _mm256_add_epi64(acc, y))
+
+PEAK_OP(avx512_add_f32,   ISA_AVX512, __m512,  16, 1, _mm512_set1_ps(float(v)), _mm512_add_ps(acc, y))
+PEAK_OP(avx512_mul_f32,   ISA_AVX512, __m512,  16, 1, _mm512_set1_ps(float(v)), _mm512_mul_ps(acc, x))
+PEAK_OP(avx512_fma_f32,   ISA_AVX512, __m512,  16, 2, _mm512_set1_ps(float(v)), _mm512_fmadd_ps(acc, x, y))
+PEAK_OP(avx512_add_f64,   ISA_AVX512, __m512d,  8, 1, _mm512_set1_pd(v), _mm512_add_pd(acc, y))
+PEAK_OP(avx512_mul_f64,   ISA_AVX512, __m512d,  8, 1, _mm512_set1_pd(v), _mm512_mul_pd(acc, x))
+PEAK_OP(avx512_fma_f64,   ISA_AVX512, __m512d,  8, 2, _mm512_set1_pd(v), _mm512_fmadd_pd(acc, x, y))
+PEAK_OP(avx512_add_i32,   ISA_AVX512, __m512i, 16, 0, _mm512_set1_epi32(int(v)), _mm512_add_epi32(acc, y))
+PEAK_OP(avx512_mullo_i32, ISA_AVX512, __m512i, 16, 0, _mm512_set1_epi32(int(v)), _mm512_mullo_epi32(acc, x))
+PEAK_OP(avx512_add_i64,   ISA_AVX512, __m512i,  8, 0, _mm512_set1_epi64((long long)v), _mm512_add_epi64(acc, y))
+PEAK_OP(avx512_mullo_i64, ISA_AVX512, __m512i,  8, 0, _mm512_set1_epi64((long long)v), _mm512_mullo_epi64(acc, x))
+
+//------------------------//
+// Peak throughput kernels
+//------------------------//
+
+// Unroll independent accumulator chains per iteration, so the core always
+// has latency x ports worth of work in flight instead of a single dependent
+// chain. The empty asm hides each accumulator from the optimizer without
+// adding instructions. One copy per target level: GCC can't inline an
+// intrinsic into a template compiled for a lower ISA.
+#define DEFINE_PEAK_KERNEL(name, isa)                                       \
+    template <typename Op, int Unroll>                                      \
+    isa void name(uint64_t iterations) {                                    \
+        typename Op::vec acc[Unroll];                                       \
+        typename Op::vec x = Op::set1(1.0), y = Op::set1(1.0);              \
+        __asm__ ("" : "+v" (x), "+v" (y)); /* no folding of x*1 */          \
+        _Pragma("GCC unroll 32")                                            \
+        for (int u = 0; u < Unroll; u++)                                    \
+            acc[u] = Op::set1(u);                                           \
+        for (uint64_t i = 0; i < iterations; i++) {                         \
+            _Pragma("GCC unroll 32")                                        \
+            for (int u = 0; u < Unroll; u++) {                              \
+                acc[u] = Op::apply(acc[u], x, y);                           \
+                __asm__ ("" : "+v" (acc[u]));                               \
+            }                                                               \
+        }                                                                   \
+        _Pragma("GCC unroll 32")                                            \
+        for (int u = 0; u < Unroll; u++)                                    \
+            __asm__ volatile ("" :: "v" (acc[u]));                          \
+    }
+
+DEFINE_PEAK_KERNEL(peak_kernel_base, )
+DEFINE_PEAK_KERNEL(peak_kernel_sse, ISA_SSE42)
+DEFINE_PEAK_KERNEL(peak_kernel_avx, ISA_AVX)
+DEFINE_PEAK_KERNEL(peak_kernel_fma, ISA_FMA)
+DEFINE_PEAK_KERNEL(peak_kernel_avx2, ISA_AVX2)
+DEFINE_PEAK_KERNEL(peak_kernel_avx512, ISA_AVX512)
+
+// 12 chains fit the 16 SSE/AVX registers next to the two operands and cover
+// 4-cycle latency on 3 ports; AVX-512 has 32 registers, enough for the
+// 10-cycle vpmullq on 2 ports.
+const int UNROLL = 12;
+const int UNROLL_AVX512 = 24;
+
+struct PeakKernel {
+    const char* isa;
+    const char* type;
+    const char* op;
+    int lanes;
+    int flops;           // per lane, 0 for integer ops
+    int unroll;
+    FeatureMask required;
+    void (*run)(uint64_t iterations);
+};
+
+#define PEAK_KERNEL(isa, type, op, Op, required, kernel, unroll) \
+    { isa, type, op, Op::lanes, Op::flops, unroll, required, kernel<Op, unroll> }
+
+const PeakKernel PEAK_KERNELS[] = {
+    PEAK_KERNEL("x86",     "double", "add",   scalar_add_f64,   0,            peak_kernel_base,   UNROLL),
+    PEAK_KERNEL("x86",     "double", "mul",   scalar_mul_f64,   0,            peak_kernel_base,   UNROLL),
+    PEAK_KERNEL("x86",     "double", "fma",   scalar_fma_f64,   NEEDS_FMA,    peak_kernel_fma,    UNROLL),
+    PEAK_KERNEL("SSE",     "float",  "add",   sse_add_f32,      0,            peak_kernel_base,   UNROLL),
+    PEAK_KERNEL("SSE",     "float",  "mul",   sse_mul_f32,      0,            peak_kernel_base,   UNROLL),
+    PEAK_KERNEL("SSE",     "double", "add",   sse_add_f64,      0,            peak_kernel_base,   UNROLL),
+    PEAK_KERNEL("SSE",     "double", "mul",   sse_mul_f64,      0,            peak_kernel_base,   UNROLL),
+    PEAK_KERNEL("SSE",     "int32",  "add",   sse_add_i32,      0,            peak_kernel_base,   UNROLL),
+    PEAK_KERNEL("SSE",     "int32",  "mullo", sse_mullo_i32,    NEEDS_SSE42,  peak_kernel_sse,    UNROLL),
+    PEAK_KERNEL("SSE",     "int64",  "add",   sse_add_i64,      0,            peak_kernel_base,   UNROLL),
+    PEAK_KERNEL("AVX",     "float",  "add",   avx_add_f32,      NEEDS_AVX,    peak_kernel_avx,    UNROLL),
+    PEAK_KERNEL("AVX",     "float",  "mul",   avx_mul_f32,      NEEDS_AVX,    peak_kernel_avx,    UNROLL),
+    PEAK_KERNEL("AVX",     "double", "add",   avx_add_f64,      NEEDS_AVX,    peak_kernel_avx,    UNROLL),
+    PEAK_KERNEL("AVX",     "double", "mul",   avx_mul_f64,      NEEDS_AVX,    peak_kernel_avx,    UNROLL),
+    PEAK_KERNEL("FMA3",    "float",  "fma",   fma128_f32,       NEEDS_FMA,    peak_kernel_fma,    UNROLL),
+    PEAK_KERNEL("FMA3",    "double", "fma",   fma128_f64,       NEEDS_FMA,    peak_kernel_fma,    UNROLL),
+    PEAK_KERNEL("FMA3 256","float",  "fma",   fma256_f32,       NEEDS_FMA,    peak_kernel_fma,    UNROLL),
+    PEAK_KERNEL("FMA3 256","double", "fma",   fma256_f64,       NEEDS_FMA,    peak_kernel_fma,    UNROLL),
+    PEAK_KERNEL("AVX2",    "int32",  "add",   avx2_add_i32,     NEEDS_AVX2,   peak_kernel_avx2,   UNROLL),
+    PEAK_KERNEL("AVX2",    "int32",  "mullo", avx2_mullo_i32,   NEEDS_AVX2,   peak_kernel_avx2,   UNROLL),
+    PEAK_KERNEL("AVX2",    "int64",  "add",   avx2_add_i64,     NEEDS_AVX2,   peak_kernel_avx2,   UNROLL),
+    PEAK_KERNEL("AVX-512", "float",  "add",   avx512_add_f32,   NEEDS_AVX512, peak_kernel_avx512, UNROLL_AVX512),
+    PEAK_KERNEL("AVX-512", "float",  "mul",   avx512_mul_f32,   NEEDS_AVX512, peak_kernel_avx512, UNROLL_AVX512),
+    PEAK_KERNEL("AVX-512", "float",  "fma",   avx512_fma_f32,   NEEDS_AVX512, peak_kernel_avx512, UNROLL_AVX512),
+    PEAK_KERNEL("AVX-512", "double", "add",   avx512_add_f64,   NEEDS_AVX512, peak_kernel_avx512, UNROLL_AVX512),
+    PEAK_KERNEL("AVX-512", "double", "mul",   avx512_mul_f64,   NEEDS_AVX512, peak_kernel_avx512, UNROLL_AVX512),
+    PEAK_KERNEL("AVX-512", "double", "fma",   avx512_fma_f64,   NEEDS_AVX512, peak_kernel_avx512, UNROLL_AVX512),
+    PEAK_KERNEL("AVX-512", "int32",  "add",   avx512_add_i32,   NEEDS_AVX512, peak_kernel_avx512, UNROLL_AVX512),
+    PEAK_KERNEL("AVX-512", "int32",  "mullo", avx512_mullo_i32, NEEDS_AVX512, peak_kernel_avx512, UNROLL_AVX512),
+    PEAK_KERNEL("AVX-512", "int64",  "add",   avx512_add_i64,   NEEDS_AVX512, peak_kernel_avx512, UNROLL_AVX512),
+    PEAK_KERNEL("AVX-512", "int64",  "mullo", avx512_mullo_i64, NEEDS_AVX512, peak_kernel_avx512, UNROLL_AVX512),
+};
+
+// Single and multi-thread runs go through the persistent pool: workers are
+// released together and the multi-thread time spans all of them. Rates are
+// from the median sample. Prints one table row and returns the multi/single
+// scaling.
+double run_benchmark(WorkerPool& pool, const PeakKernel& k, double ghz, int fp_pipes, const MeasureConfig& config) {
+    uint64_t iterations = OP_COUNT / k.unroll;
+    double ops = double(iterations) * k.unroll * k.lanes * std::max(k.flops, 1);
+    auto operations = [&](int i) {
+        perf.start(i);
+        k.run(iterations);
+        perf.stop(i);
+    };
+
+    perf.reset();
+    SampleStats single_thread = measure(config, [&] { return pool.run(1, operations); });
+    double single_thread_ops = ops / single_thread.median;
+    PerfSample single_counters = perf.total(1);
+
+    perf.reset();
+    SampleStats multi_thread = measure(config, [&] { return pool.run(NUM_THREADS, operations); });
+    double multi_thread_ops = (ops * NUM_THREADS) / multi_thread.median;
+    PerfSample multi_counters = perf.total(NUM_THREADS);
+    double ci = 100.0 * std::max(single_thread.ci, multi_thread.ci);
+
+    const char* unit = k.flops ? "GFLOP/s" : "GOP/s";
+    ResultParams params = {{"isa", k.isa}, {"type", k.type}, {"op", k.op}, {"threads", "1"}};
+    report.add_rate("peak", params, "throughput", unit, single_thread, ops / 1e9);
+    report.add_perf("peak", params, single_counters);
+
+    // Per cycle uses the counted core cycles when there are any, otherwise
+    // the clock estimated at start-up.
+    CycleStats single_cycles = cycle_stats(single_thread, single_counters, ops, 1);
+    CycleStats multi_cycles = cycle_stats(multi_thread, multi_counters, ops, NUM_THREADS);
+    report.add_cycles("peak", params, single_cycles, "op");
+    // With one worker the multi-thread run is threads=1 as well.
+    if (NUM_THREADS > 1) {
+        params.back().second = std::to_string(NUM_THREADS);
+        report.add_rate("peak", params, "throughput", unit, multi_thread, ops * NUM_THREADS / 1e9);
+        report.add_perf("peak", params, multi_counters);
+        report.add_cycles("peak", params, multi_cycles, "op");
+    }
+
+    double per_cycle = single_cycles.core_per_op > 0 ? 1.0 / single_cycles.core_per_op
+                                                     : single_thread_ops / (ghz * 1e9);
+    std::cout << std::setw(10) << k.isa << std::setw(8) << k.type << std::setw(7) << k.op
+              << std::setw(12) << single_thread_ops / 1e9 << std::setw(12) << multi_thread_ops / 1e9
+              << std::setw(9) << multi_thread_ops / single_thread_ops << std::setw(11) << per_cycle;
+    if (k.flops) {
+        double theoretical = double(fp_pipes) * k.lanes * k.flops;
+        std::cout << std::setw(13) << theoretical << std::setw(10) << 100.0 * per_cycle / theoretical << "%";
+    } else {
+        std::cout << std::setw(13) << "" << std::setw(11) << "";
+    }
+    std::cout << std::setw(8) << ci << "%";
+    if (single_counters.has(PERF_CYCLES) && single_counters.has(PERF_INSTRUCTIONS))
+        std::cout << std::setw(7) << single_counters.ipc();
+    std::cout << std::endl;
+
+    return multi_thread_ops/single_thread_ops;
+}
+
+//------------------------//
+// Sustained load
+//------------------------//
+
+// The peak table runs each kernel for about a second, which sees turbo
+// clocks only. Sustained mode keeps one FMA kernel on every worker for
+// minutes and samples the effective clock and throughput once per interval,
+// so AVX frequency licenses, power limits and thermal throttling show up.
+// 128-bit FMA3 stands in for SSE: SSE has no FMA, and the 128-bit VEX form
+// runs under the same light license.
+struct SustainLoad {
+    const char* name;
+    const char* isa;   // PEAK_KERNELS entry, double-precision fma
+};
+
+const SustainLoad SUSTAIN_LOADS[] = {
+    { "scalar", "x86" },
+    { "sse",    "FMA3" },
+    { "avx",    "FMA3 256" },
+    { "avx512", "AVX-512" },
+};
+
+// Vector instructions per worker between clock checks, ~1 ms.
+const uint64_t SUSTAIN_SLICE = 1 << 22;
+// Burst is the mean over the first seconds, steady state over the last half.
+const double BURST_SECONDS = 2.0;
+// Settled once every later interval is within this fraction of steady state.
+const double SETTLED_BAND = 0.03;
+
+// Where the effective clock comes from, best first. APERF counts at the
+// actual clock and MPERF at the TSC rate (P0 on AMD, the same on current
+// parts), both only while the core is in C0, so their ratio times the TSC
+// rate is the clock the work really ran at. Counted user cycles over the
+// elapsed time are as good while the worker keeps its core. cpufreq is the
+// governor's last requested P-state and misses hardware licenses and
+// throttling.
+enum FrequencySource { FREQUENCY_MSR, FREQUENCY_PERF, FREQUENCY_CPUFREQ, FREQUENCY_NONE };
+const char* const FREQUENCY_SOURCE_NAMES[] = {
+    "APERF/MPERF via /dev/cpu/*/msr", "perf cycles", "cpufreq scaling_cur_freq", "none"
+};
+
+const uint32_t MSR_MPERF = 0xE7;
+const uint32_t MSR_APERF = 0xE8;
+
+// /dev/cpu/N/msr of the calling thread's CPU, -1 without the msr driver or
+// the permission to read it.
+int open_msr() {
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    return cpu < 0 ? -1 : open(("/dev/cpu/" + std::to_string(cpu) + "/msr").c_str(), O_RDONLY);
+#else
+    return -1;
+#endif
+}
+
+bool read_msr(int fd, uint32_t reg, uint64_t& value) {
+#ifdef __linux__
+    return fd >= 0 && pread(fd, &value, sizeof(value), reg) == static_cast<ssize_t>(sizeof(value));
+#else
+    (void)fd; (void)reg; (void)value;
+    return false;
+#endif
+}
+
+void close_msr(int fd) {
+#ifdef __linux__
+    if (fd >= 0)
+        close(fd);
+#else
+    (void)fd;
+#endif
+}
 
-// Scalar implementations
-template <typename T>
-void scalar_operations(const char* type_name, double& thread_time, uint64_t ops) {
-    T* buffer = new T[32];
-    T counter = 0;
-    
-    auto start = std::chrono::high_resolution_clock::now();
-    for (uint64_t i = 0; i < ops; ++i) {
-        counter += static_cast<T>(1);
-    }
-    buffer[0] = counter;
-    auto end = std::chrono::high_resolution_clock::now();
-    
-    thread_time = std::chrono::duration<double>(end - start).count();
-    delete[] buffer;
+std::string cpufreq_path() {
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    return "/sys/devices/system/cpu/cpu" + std::to_string(std::max(cpu, 0)) + "/cpufreq/scaling_cur_freq";
+#else
+    return "";
+#endif
 }
 
-// SSE implementations
-template <typename T>
-void sse_operations(const char* type_name, double& thread_time, uint64_t ops) {
-    const size_t elements_per_op = sizeof(__m128) / sizeof(T);
-    T* buffer = static_cast<T*>(_mm_malloc(32 * sizeof(T), 16));
-    
-    auto start = std::chrono::high_resolution_clock::now();
-    
-    if (std::is_floating_point<T>::value) {
-        __m128 counter = _mm_setzero_ps();
-        __m128 one = _mm_set1_ps(1.0f);
-        for (uint64_t i = 0; i < ops / elements_per_op; ++i) {
-            counter = _mm_add_ps(counter, one);
+// Picked once on worker 0, so every worker and load uses the same source.
+FrequencySource detect_frequency_source(WorkerPool& pool) {
+    FrequencySource source = FREQUENCY_NONE;
+    pool.run(1, [&](int i) {
+        uint64_t value;
+        int fd = open_msr();
+        bool msr = read_msr(fd, MSR_APERF, value) && read_msr(fd, MSR_MPERF, value);
+        close_msr(fd);
+        perf.reset();
+        perf.start(i);
+        peak_kernel_base<scalar_add_f64, UNROLL>(1024);
+        perf.stop(i);
+        if (msr)
+            source = FREQUENCY_MSR;
+        else if (perf.worker(i).has(PERF_CYCLES))
+            source = FREQUENCY_PERF;
+        else if (read_sysfs_int(cpufreq_path(), 0) > 0)
+            source = FREQUENCY_CPUFREQ;
+    });
+    return source;
+}
+
+// Effective clock of the calling worker's core over each interval between
+// begin() and end().
+class CoreClock {
+public:
+    CoreClock(FrequencySource source, int worker) : source_(source), worker_(worker) {
+        if (source_ == FREQUENCY_MSR)
+            msr_ = open_msr();
+        else if (source_ == FREQUENCY_CPUFREQ)
+            cpufreq_ = cpufreq_path();
+    }
+    ~CoreClock() { close_msr(msr_); }
+    CoreClock(const CoreClock&) = delete;
+    CoreClock& operator=(const CoreClock&) = delete;
+
+    void begin() {
+        if (source_ == FREQUENCY_MSR) {
+            read_msr(msr_, MSR_APERF, aperf_);
+            read_msr(msr_, MSR_MPERF, mperf_);
+        } else if (source_ == FREQUENCY_PERF) {
+            cycles_ = perf.worker(worker_)[PERF_CYCLES];
+            perf.start(worker_);
         }
-        _mm_store_ps(reinterpret_cast<float*>(buffer), counter);
-    } else {
-        __m128i counter = _mm_setzero_si128();
-        __m128i one = _mm_set1_epi32(1);
-        for (uint64_t i = 0; i < ops / elements_per_op; ++i) {
-            counter = _mm_add_epi32(counter, one);
+    }
+
+    // GHz since begin(), 0 if unknown.
+    double end(double seconds) {
+        switch (source_) {
+        case FREQUENCY_MSR: {
+            uint64_t aperf = 0, mperf = 0;
+            if (!read_msr(msr_, MSR_APERF, aperf) || !read_msr(msr_, MSR_MPERF, mperf) || mperf == mperf_)
+                return 0.0;
+            return tsc_info().hz * double(aperf - aperf_) / double(mperf - mperf_) / 1e9;
+        }
+        case FREQUENCY_PERF:
+            perf.stop(worker_);
+            return (perf.worker(worker_)[PERF_CYCLES] - cycles_) / seconds / 1e9;
+        case FREQUENCY_CPUFREQ:
+            return read_sysfs_int(cpufreq_, 0) / 1e6;
+        default:
+            return 0.0;
         }
-        _mm_store_si128(reinterpret_cast<__m128i*>(buffer), counter);
     }
-    
-    auto end = std::chrono::high_resolution_clock::now();
-    thread_time = std::chrono::duration<double>(end - start).count();
-    _mm_free(buffer);
+
+private:
+    FrequencySource source_;
+    int worker_;
+    int msr_ = -1;
+    std::string cpufreq_;
+    uint64_t aperf_ = 0, mperf_ = 0;
+    double cycles_ = 0;
+};
+
+// Package temperature file: the x86_pkg_temp thermal zone, else the first
+// zone, else empty.
+std::string thermal_zone_path() {
+    std::string first;
+    for (int zone = 0; zone < 256; zone++) {
+        std::string base = "/sys/class/thermal/thermal_zone" + std::to_string(zone) + "/";
+        std::string type = read_sysfs_line(base + "type");
+        if (type.empty())
+            break;
+        if (type == "x86_pkg_temp")
+            return base + "temp";
+        if (first.empty())
+            first = base + "temp";
+    }
+    return first;
 }
 
-// AVX implementations
-template <typename T>
-void avx_operations(const char* type_name, double& thread_time, uint64_t ops) {
-    const size_t elements_per_op = sizeof(__m256d) / sizeof(T);
-    T* buffer = static_cast<T*>(_mm_malloc(32 * sizeof(T), 32));
-    
-    auto start = std::chrono::high_resolution_clock::now();
-    
-    if (std::is_floating_point<T>::value) {
-        __m256d counter = _mm256_setzero_pd();
-        __m256d one = _mm256_set1_pd(1.0);
-        for (uint64_t i = 0; i < ops / elements_per_op; ++i) {
-            counter = _mm256_add_pd(counter, one);
-        }
-        _mm256_store_pd(reinterpret_cast<double*>(buffer), counter);
-    } else {
-        // Fallback to SSE for integers
-        __m128i counter = _mm_setzero_si128();
-        __m128i one = _mm_set1_epi32(1);
-        for (uint64_t i = 0; i < ops / (elements_per_op/2); ++i) {
-            counter = _mm_add_epi32(counter, one);
+double read_celsius(const std::string& path) {
+    int millidegrees = path.empty() ? -1 : read_sysfs_int(path, -1);
+    return millidegrees < 0 ? NAN : millidegrees / 1000.0;
+}
+
+struct SustainSample {
+    double seconds;   // end of the interval, since the load started
+    double interval;  // its length
+    double ops;       // operations completed in it
+    double ghz;       // effective clock, 0 if unknown
+    double celsius;   // worker 0 only, NaN otherwise or without a sensor
+};
+
+// One interval summed over the workers.
+struct SustainPoint {
+    double seconds;
+    double rate;      // operations per second, all workers
+    double ghz, min_ghz, max_ghz;  // over workers, 0 if unknown
+    double celsius;
+};
+
+struct SustainPhase {
+    double rate = 0, ghz = 0, celsius = NAN;
+};
+
+// Mean over the points in [from, to) seconds.
+SustainPhase sustain_phase(const std::vector<SustainPoint>& points, double from, double to) {
+    SustainPhase phase;
+    int count = 0, temperatures = 0;
+    double celsius = 0;
+    for (const SustainPoint& p : points) {
+        if (p.seconds <= from || (p.seconds > to && count > 0))
+            continue;
+        phase.rate += p.rate;
+        phase.ghz += p.ghz;
+        count++;
+        if (!std::isnan(p.celsius)) {
+            celsius += p.celsius;
+            temperatures++;
         }
-        _mm_store_si128(reinterpret_cast<__m128i*>(buffer), counter);
     }
-    
-    auto end = std::chrono::high_resolution_clock::now();
-    thread_time = std::chrono::duration<double>(end - start).count();
-    _mm_free(buffer);
+    if (count) {
+        phase.rate /= count;
+        phase.ghz /= count;
+    }
+    if (temperatures)
+        phase.celsius = celsius / temperatures;
+    return phase;
 }
 
-template <typename T, typename Func>
-double run_benchmark(Func func, const char* isa_name, const char* type_name) {
-    double single_thread_time;
-    func(type_name, single_thread_time, OP_COUNT);
-    double single_thread_ops = OP_COUNT / single_thread_time;
+struct SustainResult {
+    const char* name;
+    SustainPhase burst, steady;
+    double settled;   // seconds until throughput stays within SETTLED_BAND of steady
+};
+
+// Runs k on every worker for `duration` seconds, printing one row per
+// interval. Workers check the clock between slices and keep their own
+// series, so sampling adds no synchronization to the load.
+SustainResult run_sustained(WorkerPool& pool, const SustainLoad& load, const PeakKernel& k,
+                            FrequencySource source, double duration, double interval) {
+    uint64_t iterations = SUSTAIN_SLICE / k.unroll;
+    double slice_ops = double(iterations) * k.unroll * k.lanes * k.flops;
+    std::string zone = thermal_zone_path();
+    std::vector<WorkerSlot<std::vector<SustainSample>>> series(NUM_THREADS);
+    for (auto& s : series)
+        s.value.reserve(size_t(duration / interval) + 2);
+
+    perf.reset();
+    pool.run(NUM_THREADS, [&](int i) {
+        std::vector<SustainSample>& samples = series[i].value;
+        CoreClock clock(source, i);
+        uint64_t start = timer_begin();
+        double mark = 0, ops = 0;
+        clock.begin();
+        for (;;) {
+            k.run(iterations);
+            ops += slice_ops;
+            double now = timer_seconds(timer_end() - start);
+            if (now - mark < interval)
+                continue;
+            double ghz = clock.end(now - mark);
+            samples.push_back({ now, now - mark, ops, ghz, i == 0 ? read_celsius(zone) : NAN });
+            if (now >= duration)
+                break;
+            ops = 0;
+            mark = now;
+            clock.begin();
+        }
+    });
 
-    std::vector<std::thread> threads(NUM_THREADS);
-    std::vector<double> thread_times(NUM_THREADS);
+    size_t count = series[0].value.size();
+    for (const auto& s : series)
+        count = std::min(count, s.value.size());
+    std::vector<SustainPoint> points;
+    for (size_t n = 0; n < count; n++) {
+        const SustainSample& first = series[0].value[n];
+        SustainPoint p = { first.seconds, 0, 0, 0, 0, first.celsius };
+        int clocks = 0;
+        for (const auto& s : series) {
+            const SustainSample& sample = s.value[n];
+            p.rate += sample.ops / sample.interval;
+            if (sample.ghz > 0) {
+                p.min_ghz = clocks ? std::min(p.min_ghz, sample.ghz) : sample.ghz;
+                p.max_ghz = std::max(p.max_ghz, sample.ghz);
+                p.ghz += sample.ghz;
+                clocks++;
+            }
+        }
+        if (clocks)
+            p.ghz /= clocks;
+        points.push_back(p);
+    }
 
-    for (unsigned i = 0; i < NUM_THREADS; ++i) {
-        threads[i] = std::thread([&, i]() {
-            func(type_name, thread_times[i], OP_COUNT);
-        });
+    std::cout << "\n" << load.name << " (" << k.isa << " double fma), " << NUM_THREADS
+              << " threads, " << duration << " s\n";
+    std::cout << std::setw(8) << "t (s)" << std::setw(10) << "GFLOP/s" << std::setw(8) << "GHz"
+              << std::setw(8) << "min" << std::setw(8) << "max" << std::setw(7) << "C" << "\n";
+    for (size_t n = 0; n < points.size(); n++) {
+        const SustainPoint& p = points[n];
+        std::cout << std::setw(8) << p.seconds << std::setw(10) << p.rate / 1e9;
+        if (p.ghz > 0)
+            std::cout << std::setw(8) << p.ghz << std::setw(8) << p.min_ghz << std::setw(8) << p.max_ghz;
+        else
+            std::cout << std::setw(24) << "";
+        if (!std::isnan(p.celsius))
+            std::cout << std::setw(7) << std::setprecision(0) << p.celsius << std::setprecision(2);
+        std::cout << "\n";
+        // Keyed on the interval number, not the measured time, so series
+        // with the same --interval match across runs.
+        ResultParams params = {{"isa", load.name}, {"threads", std::to_string(NUM_THREADS)},
+                               {"interval", std::to_string(n + 1)}};
+        report.add_value("sustain_series", params, "throughput", "GFLOP/s", p.rate / 1e9, true);
+        if (p.ghz > 0)
+            report.add_value("sustain_series", params, "core_clock", "GHz", p.ghz, true);
     }
 
-    for (auto& t : threads) t.join();
+    SustainResult result = { load.name, {}, {}, 0.0 };
+    double end = points.empty() ? 0.0 : points.back().seconds;
+    result.burst = sustain_phase(points, 0.0, BURST_SECONDS);
+    result.steady = sustain_phase(points, end / 2, end);
+    for (const SustainPoint& p : points)
+        if (std::abs(p.rate - result.steady.rate) > SETTLED_BAND * result.steady.rate)
+            result.settled = p.seconds;
+    return result;
+}
 
-    double max_time = *std::max_element(thread_times.begin(), thread_times.end());
-    double multi_thread_ops = (OP_COUNT * NUM_THREADS) / max_time;
+// Burst and steady state per load, and each load's steady clock against the
+// scalar one: the frequency offset of its license.
+void sustained_benchmark(WorkerPool& pool, double duration, const std::string& which, double interval, double rest) {
+    FrequencySource source = detect_frequency_source(pool);
+    std::string zone = thermal_zone_path();
+    std::cout << "Clock source: " << FREQUENCY_SOURCE_NAMES[source]
+              << ", temperature: " << (zone.empty() ? "unavailable" : zone) << "\n";
+    std::cout << "Sampled every " << interval << " s; burst is the first " << BURST_SECONDS
+              << " s, steady state the second half; " << rest << " s idle between loads\n";
 
-    std::cout << "ISA: " << isa_name << " | Type: " << type_name << "\n"
-              << "Single: " << single_thread_ops/1e9 << " GOP/s\n"
-              << "Multi (" << NUM_THREADS << "): " << multi_thread_ops/1e9 << " GOP/s\n"
-              << "Scaling: " << multi_thread_ops/single_thread_ops << "\n"
-              << "------------------------\n";
+    std::vector<SustainResult> results;
+    for (const SustainLoad& load : SUSTAIN_LOADS) {
+        if (which != "all" && which != load.name)
+            continue;
+        const PeakKernel* kernel = nullptr;
+        for (const PeakKernel& k : PEAK_KERNELS)
+            if (std::string(k.isa) == load.isa && std::string(k.type) == "double" && std::string(k.op) == "fma")
+                kernel = &k;
+        if (!kernel || !cpu_info().supports(kernel->required)) {
+            std::cout << "\n" << load.name << ": not supported on this host\n";
+            continue;
+        }
+        if (!results.empty())
+            std::this_thread::sleep_for(std::chrono::duration<double>(rest));
+        results.push_back(run_sustained(pool, load, *kernel, source, duration, interval));
+    }
+    if (results.empty()) {
+        std::cout << "No load matches '" << which << "' (scalar, sse, avx, avx512 or all)\n";
+        return;
+    }
 
-    return multi_thread_ops/single_thread_ops;
+    const SustainResult* scalar = results[0].name == std::string("scalar") ? &results[0] : nullptr;
+    std::cout << "\n" << std::setw(8) << "Load" << std::setw(12) << "Burst GF/s" << std::setw(13) << "Steady GF/s"
+              << std::setw(8) << "Drop" << std::setw(11) << "Burst GHz" << std::setw(12) << "Steady GHz"
+              << std::setw(10) << "Offset" << std::setw(11) << "Settled s" << std::setw(10) << "Steady C" << "\n";
+    for (const SustainResult& r : results) {
+        double drop = r.burst.rate > 0 ? 100.0 * (1.0 - r.steady.rate / r.burst.rate) : 0.0;
+        std::cout << std::setw(8) << r.name << std::setw(12) << r.burst.rate / 1e9
+                  << std::setw(13) << r.steady.rate / 1e9 << std::setw(7) << drop << "%";
+        if (r.steady.ghz > 0) {
+            std::cout << std::setw(11) << r.burst.ghz << std::setw(12) << r.steady.ghz;
+            if (scalar && scalar->steady.ghz > 0)
+                std::cout << std::setw(9) << 100.0 * (r.steady.ghz / scalar->steady.ghz - 1.0) << "%";
+            else
+                std::cout << std::setw(10) << "";
+        } else {
+            std::cout << std::setw(33) << "";
+        }
+        std::cout << std::setw(11) << r.settled;
+        if (!std::isnan(r.steady.celsius))
+            std::cout << std::setw(10) << std::setprecision(0) << r.steady.celsius << std::setprecision(2);
+        std::cout << "\n";
+
+        ResultParams params = {{"isa", r.name}, {"threads", std::to_string(NUM_THREADS)}, {"phase", "burst"}};
+        report.add_value("sustain", params, "throughput", "GFLOP/s", r.burst.rate / 1e9, true);
+        if (r.burst.ghz > 0)
+            report.add_value("sustain", params, "core_clock", "GHz", r.burst.ghz, true);
+        params.back().second = "steady";
+        report.add_value("sustain", params, "throughput", "GFLOP/s", r.steady.rate / 1e9, true);
+        // The offset is only printed: as a record, a relative comparison of a
+        // percentage near 0 is meaningless. The steady clocks it comes from
+        // are compared directly.
+        if (r.steady.ghz > 0)
+            report.add_value("sustain", params, "core_clock", "GHz", r.steady.ghz, true);
+        report.add_value("sustain", params, "settled", "s", r.settled, false);
+    }
+    if (!scalar && results[0].steady.ghz > 0)
+        std::cout << "Offset is against the scalar load; run it too (or 'all') to get one\n";
 }
 
-int main() {
-    // C++11-compatible benchmarking
-    std::cout << "\n=== BENCHMARKING double ===\n";
-    run_benchmark<double>(scalar_operations<double>, "x86", "double");
-    run_benchmark<double>(sse_operations<double>, "SSE", "double");
-    run_benchmark<double>(avx_operations<double>, "AVX", "double");
-
-    std::cout << "\n=== BENCHMARKING float ===\n";
-    run_benchmark<float>(scalar_operations<float>, "x86", "float");
-    run_benchmark<float>(sse_operations<float>, "SSE", "float");
-    run_benchmark<float>(avx_operations<float>, "AVX", "float");
-
-    std::cout << "\n=== BENCHMARKING int64 ===\n";
-    run_benchmark<int64_t>(scalar_operations<int64_t>, "x86", "int64");
-    run_benchmark<int64_t>(sse_operations<int64_t>, "SSE", "int64");
-    run_benchmark<int64_t>(avx_operations<int64_t>, "AVX", "int64");
-
-    std::cout << "\n=== BENCHMARKING int32 ===\n";
-    run_benchmark<int32_t>(scalar_operations<int32_t>, "x86", "int32");
-    run_benchmark<int32_t>(sse_operations<int32_t>, "SSE", "int32");
-    run_benchmark<int32_t>(avx_operations<int32_t>, "AVX", "int32");
-
-    std::cout << "\n=== BENCHMARKING int8 ===\n";
-    run_benchmark<int8_t>(scalar_operations<int8_t>, "x86", "int8");
-    run_benchmark<int8_t>(sse_operations<int8_t>, "SSE", "int8");
-    run_benchmark<int8_t>(avx_operations<int8_t>, "AVX", "int8");
-
-    return 0;
-}
\ No newline at end of file
+// Usage: cpu_bench_2 [--affinity=scatter|compact|physical|none|<cpu list>] [--fp-pipes=N]
+//                    [--warmup=N] [--reps=N | --min-reps=N --max-reps=N --max-time=S --ci=PCT] [--outliers=K]
+//                    [--json=FILE] [--csv=FILE] [--compare=BASELINE.json] [--threshold=PCT] [--timer=tsc|steady]
+//        cpu_bench_2 sustain [seconds] [scalar|sse|avx|avx512|all] [--interval=S] [--rest=S]
+//                    FMA load on every --affinity CPU for `seconds` per load (default 120, all loads):
+//                    clock, throughput and temperature every --interval (default 1 s), burst vs
+//                    steady state and per-ISA clock offset, --rest idle seconds between loads (default 10)
+// --fp-pipes is the number of vector FP pipes per core the theoretical
+// FLOP/cycle assumes (default 2; 1 on e.g. single-FMA AVX-512 SKUs).
+int main(int argc, char** argv) {
+    report.init("cpu_bench_2", argc, argv);
+    AffinityConfig affinity;
+    thread_cpus = affinity_from_args(argc, argv, affinity);
+    NUM_THREADS = thread_cpus.size();
+    std::string value;
+    int fp_pipes = take_option(argc, argv, "--fp-pipes", value) ? std::stoi(value) : 2;
+    double interval = take_option(argc, argv, "--interval", value) ? std::stod(value) : 1.0;
+    double rest = take_option(argc, argv, "--rest", value) ? std::stod(value) : 10.0;
+    MeasureConfig config;
+    config.min_samples = 3;
+    measure_config_from_args(argc, argv, config);
+    timer_from_args(argc, argv);
+    report.set_placement(affinity, thread_cpus);
+    report.set_sampling(config);
+
+    std::cout << describe_measure_config(config) << "\n";
+    std::cout << describe_timer() << "\n";
+    std::cout << describe_affinity(affinity, thread_cpus) << "\n";
+    WorkerPool pool(thread_cpus);
+    perf.open(pool);
+    std::cout << perf.describe() << "\n";
+
+    if (argc > 1 && std::string(argv[1]) == "sustain") {
+        double duration = argc > 2 ? std::stod(argv[2]) : 120.0;
+        std::string which = argc > 3 ? argv[3] : "all";
+        std::cout << std::fixed << std::setprecision(2);
+        sustained_benchmark(pool, duration, which, interval, rest);
+        return report.finish(0);
+    }
+
+    double ghz = 0.0;
+    pool.run(1, [&](int) { ghz = estimate_core_ghz(); });
+    report.add_value("clock", {}, "core_clock", "GHz", ghz, true);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Core clock ~" << ghz << " GHz on worker 0, theoretical assumes "
+              << fp_pipes << " FP pipes per core\n";
+    std::cout << "Median throughput in GFLOP/s (GOP/s for integer ops)\n"
+              << "Per cycle is single-thread, over " << (perf.available() ? "counted core cycles" : "the estimated clock")
+              << "; IPC is single-thread\n"
+              << "CI95 is the wider of the single/multi 95% confidence intervals\n";
+    std::cout << "------------------------\n";
+    std::cout << std::setw(10) << "ISA" << std::setw(8) << "Type" << std::setw(7) << "Op"
+              << std::setw(12) << "Single" << std::setw(12) << ("Multi(" + std::to_string(NUM_THREADS) + ")")
+              << std::setw(9) << "Scaling" << std::setw(11) << "Per cycle"
+              << std::setw(13) << "Theoretical" << std::setw(11) << "Efficiency" << std::setw(9) << "CI95";
+    if (perf.available())
+        std::cout << std::setw(7) << "IPC";
+    std::cout << "\n";
+
+    for (const PeakKernel& k : PEAK_KERNELS) {
+        if (!cpu_info().supports(k.required)) {
+            std::cout << std::setw(10) << k.isa << std::setw(8) << k.type << std::setw(7) << k.op
+                      << "  not supported on this host\n";
+            continue;
+        }
+        run_benchmark(pool, k, ghz, fp_pipes, config);
+    }
+
+    return report.finish(0);
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+// Clocks for timed regions: serialized TSC reads with the TSC frequency
+// from cpuid or calibration, steady_clock as the fallback, and an estimate
+// of the actual core clock for converting wall time into core cycles.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <x86intrin.h>
+
+#include "bench_args.h"
+#include "cpu_info.h"
+
+//------------------------//
+// Time stamp counter
+//------------------------//
+
+// LFENCE before RDTSC waits for earlier instructions to finish, and the
+// one after keeps the timed code from starting before the read.
+inline uint64_t tsc_begin() {
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+}
+
+// RDTSCP waits for the timed code to finish; LFENCE keeps later code out.
+inline uint64_t tsc_end() {
+    unsigned aux;
+    uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+}
+
+struct TscInfo {
+    bool invariant = false;  // constant rate in all P-/C-states (cpuid 0x80000007 EDX[8])
+    bool rdtscp = false;     // cpuid 0x80000001 EDX[27]
+    double hz = 0;
+    const char* source = "none";  // "cpuid 0x15", "cpuid 0x16" or "calibrated"
+};
+
+// TSC ticks per second measured against steady_clock: median of three 50 ms windows.
+inline double calibrate_tsc_hz() {
+    double rates[3];
+    for (double& rate : rates) {
+        auto wall_start = std::chrono::steady_clock::now();
+        uint64_t tsc_start = tsc_begin();
+        while (std::chrono::steady_clock::now() - wall_start < std::chrono::milliseconds(50))
+            ;
+        uint64_t ticks = tsc_end() - tsc_start;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+        rate = ticks / seconds;
+    }
+    std::sort(rates, rates + 3);
+    return rates[1];
+}
+
+inline TscInfo detect_tsc() {
+    TscInfo info;
+    int r[4];
+    cpuid(0x80000000, 0, r);
+    unsigned max_extended = r[0];
+    if (max_extended >= 0x80000001) {
+        cpuid(0x80000001, 0, r);
+        info.rdtscp = (r[3] >> 27) & 1;
+    }
+    if (max_extended >= 0x80000007) {
+        cpuid(0x80000007, 0, r);
+        info.invariant = (r[3] >> 8) & 1;
+    }
+
+    // Leaf 0x15: TSC = crystal * EBX / EAX. Without the crystal frequency
+    // (ECX = 0) the TSC runs at the base clock from leaf 0x16.
+    int max_leaf = cpu_info().max_leaf;
+    if (max_leaf >= 0x15) {
+        cpuid(0x15, 0, r);
+        if (r[0] && r[1] && r[2]) {
+            info.hz = double(unsigned(r[2])) * unsigned(r[1]) / unsigned(r[0]);
+            info.source = "cpuid 0x15";
+        } else if (max_leaf >= 0x16) {
+            cpuid(0x16, 0, r);
+            if (r[0] & 0xffff) {
+                info.hz = (r[0] & 0xffff) * 1e6;
+                info.source = "cpuid 0x16";
+            }
+        }
+    }
+    // Hypervisors often hide these leaves; trust cpuid only within 1% of a measurement.
+    double measured = calibrate_tsc_hz();
+    if (info.hz == 0 || std::abs(info.hz - measured) > 0.01 * measured) {
+        info.hz = measured;
+        info.source = "calibrated";
+    }
+    return info;
+}
+
+// Detected and calibrated once per process.
+inline const TscInfo& tsc_info() {
+    static const TscInfo info = detect_tsc();
+    return info;
+}
+
+//------------------------//
+// Region timer
+//------------------------//
+
+// Timed regions use the TSC when it is invariant and RDTSCP exists, unless
+// --timer=steady asks for std::chrono::steady_clock.
+inline bool& use_tsc_timer() {
+    static bool enabled = tsc_info().invariant && tsc_info().rdtscp;
+    return enabled;
+}
+
+inline void timer_from_args(int& argc, char** argv) {
+    std::string value;
+    if (take_option(argc, argv, "--timer", value))
+        use_tsc_timer() = value == "tsc";
+}
+
+inline std::string describe_timer() {
+    const TscInfo& tsc = tsc_info();
+    std::string text = use_tsc_timer() ? "Timer: RDTSCP" : "Timer: steady_clock";
+    text += ", TSC " + std::to_string(tsc.hz / 1e9).substr(0, 5) + " GHz (" + tsc.source + ", " +
+            (tsc.invariant ? "invariant" : "not invariant") + ")";
+    return text;
+}
+
+// A point in time from the selected clock, in TSC ticks or steady_clock
+// nanoseconds. Only differences are meaningful.
+inline uint64_t timer_begin() {
+    if (use_tsc_timer())
+        return tsc_begin();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t timer_end() {
+    if (use_tsc_timer())
+        return tsc_end();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline double timer_seconds(uint64_t ticks) {
+    return use_tsc_timer() ? ticks / tsc_info().hz : ticks * 1e-9;
+}
+
+//------------------------//
+// Core clock
+//------------------------//
+
+// Core clock in GHz, timed over a chain of dependent adds (one per cycle).
+// Runs on the calling thread, so pin it first to measure a specific core.
+inline double estimate_core_ghz() {
+    // Register operands: some cores fold add-immediate chains at rename.
+    const uint64_t iterations = 1ULL << 26;
+    uint64_t x = 0, one = 1;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++) {
+        __asm__ volatile (
+            "add %1, %0\n\tadd %1, %0\n\tadd %1, %0\n\tadd %1, %0\n\t"
+            "add %1, %0\n\tadd %1, %0\n\tadd %1, %0\n\tadd %1, %0\n\t"
+            "add %1, %0\n\tadd %1, %0\n\tadd %1, %0\n\tadd %1, %0\n\t"
+            "add %1, %0\n\tadd %1, %0\n\tadd %1, %0\n\tadd %1, %0"
+            : "+r" (x) : "r" (one));
+    }
+    auto end = std::chrono::steady_clock::now();
+    return (iterations * 16.0) / std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
@@ -1,44 +1,77 @@
 #include <iostream>
-#include <cstring>
-
-void cpuid(int eax, int ecx, int* cpuInfo) {
-    __asm__ (
-        "cpuid"
-        : "=a" (cpuInfo[0]), "=b" (cpuInfo[1]), "=c" (cpuInfo[2]), "=d" (cpuInfo[3])
-        : "a" (eax), "c" (ecx)
-    );
-}
+#include <iomanip>
+
+#include "cpu_info.h"
+#include "cpu_topology.h"
 
 void printCPUBrand() {
-    int cpuInfo[4];
-    char brand[0x40];
-    std::memset(brand, 0, sizeof(brand));
-
-    cpuid(0x80000002, 0, cpuInfo);
-    std::memcpy(brand, cpuInfo, sizeof(cpuInfo));
-    cpuid(0x80000003, 0, cpuInfo);
-    std::memcpy(brand + 16, cpuInfo, sizeof(cpuInfo));
-    cpuid(0x80000004, 0, cpuInfo);
-    std::memcpy(brand + 32, cpuInfo, sizeof(cpuInfo));
-
-    std::cout << "CPU Brand String: " << brand << std::endl;
+    std::cout << "CPU Brand String: " << cpu_info().brand << std::endl;
 }
 
 void printCPUIDInfo() {
-    int cpuInfo[4];
-    cpuid(1, 0, cpuInfo);
+    const CpuInfo& info = cpu_info();
+    std::cout << "CPU Vendor: " << info.vendor << std::endl;
+    std::cout << "CPU Family: " << info.family << std::endl;
+    std::cout << "CPU Model: " << info.model << std::endl;
+    std::cout << "CPU Stepping: " << info.stepping << std::endl;
+}
+
+void printCPUFeatures() {
+    const CpuInfo& info = cpu_info();
+    std::cout << "Features: " << feature_list(info.features) << std::endl;
+    FeatureMask disabled = info.hardware & ~info.features;
+    if (disabled)
+        std::cout << "Disabled by OS: " << feature_list(disabled) << std::endl;
+
+    std::cout << std::hex << std::setfill('0');
+    std::cout << "XCR0: 0x" << std::setw(16) << info.xcr0
+              << " (CPU supports 0x" << std::setw(16) << info.xcr0_supported << ")" << std::endl;
+    std::cout << std::dec << std::setfill(' ');
+    std::cout << "XSAVE area: " << info.xsave_size << " bytes"
+              << (info.xsaveopt ? ", XSAVEOPT" : "") << (info.xsavec ? ", XSAVEC" : "")
+              << (info.xsaves ? ", XSAVES" : "") << std::endl;
+}
+
+// Cache hierarchy, then which logical CPU sits on which core, package and
+// node, with the SMT siblings and the CPUs sharing each cache instance.
+void printTopology() {
+    const CpuTopology& topology = cpu_topology();
+    std::cout << describe_topology(topology) << std::endl;
+
+    std::cout << "Logical CPU map:" << std::endl;
+    std::cout << std::setw(6) << "CPU" << std::setw(9) << "Package" << std::setw(6) << "Core"
+              << std::setw(6) << "Node" << std::setw(6) << "SMT" << "  Siblings" << std::endl;
+    for (const LogicalCpu& c : topology.cpus) {
+        std::string siblings;
+        for (int cpu : topology.smt_siblings(c.cpu))
+            siblings += (siblings.empty() ? "" : ",") + std::to_string(cpu);
+        std::cout << std::setw(6) << c.cpu << std::setw(9) << c.package << std::setw(6) << c.core
+                  << std::setw(6) << c.node << std::setw(6) << c.smt_rank << "  " << siblings << std::endl;
+    }
+
+    for (int node : topology.nodes) {
+        std::string cpus;
+        for (int cpu : node_cpus(topology.cpus, node))
+            cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+        std::cout << "Node " << node << ": CPUs " << cpus << std::endl;
+    }
 
-    int family = ((cpuInfo[0] >> 8) & 0xf) + ((cpuInfo[0] >> 20) & 0xff);
-    int model = ((cpuInfo[0] >> 4) & 0xf) + ((cpuInfo[0] >> 12) & 0xf0);
-    int stepping = cpuInfo[0] & 0xf;
+    for (const CacheLevel& c : topology.caches) {
+        for (size_t i = 0; i < c.instances.size(); i++) {
+            std::string cpus;
+            for (int cpu : c.instances[i])
+                cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+            std::cout << "L" << c.level << " " << c.type << " #" << i << ": CPUs " << cpus << std::endl;
+        }
+    }
 
-    std::cout << "CPU Family: " << family << std::endl;
-    std::cout << "CPU Model: " << model << std::endl;
-    std::cout << "CPU Stepping: " << stepping << std::endl;
+    std::cout << "Memory working set: " << format_size(topology.memory_working_set()) << std::endl;
 }
 
 int main() {
     printCPUBrand();
     printCPUIDInfo();
+    printCPUFeatures();
+    printTopology();
     return 0;
 }
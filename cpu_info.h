@@ -0,0 +1,236 @@
+#pragma once
+
+// CPU identification and feature detection shared by all benchmarks.
+// A feature only counts as available when the CPU reports it (cpuid leaves
+// 1, 7 and 0xD) and the OS saves the matching register state (XCR0), so
+// kernels picked from a dispatch table never fault with SIGILL.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Function attributes for kernels built for a higher ISA than the baseline.
+// Only call them after checking the matching FeatureMask below.
+#define ISA_SSE42  __attribute__((target("sse4.2")))
+#define ISA_POPCNT __attribute__((target("popcnt")))
+#define ISA_BMI2   __attribute__((target("bmi2")))
+#define ISA_AVX    __attribute__((target("avx")))
+#define ISA_FMA    __attribute__((target("fma")))
+#define ISA_AVX2   __attribute__((target("avx2")))
+#define ISA_AVX512 __attribute__((target("avx512f,avx512dq,avx512bw,avx512vl")))
+
+inline void cpuid(int eax, int ecx, int* cpuInfo) {
+    __asm__ (
+        "cpuid"
+        : "=a" (cpuInfo[0]), "=b" (cpuInfo[1]), "=c" (cpuInfo[2]), "=d" (cpuInfo[3])
+        : "a" (eax), "c" (ecx)
+    );
+}
+
+inline uint64_t xgetbv(unsigned index) {
+    uint32_t lo, hi;
+    __asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (index));
+    return (uint64_t(hi) << 32) | lo;
+}
+
+enum CpuFeature {
+    CPU_SSE2, CPU_SSE3, CPU_SSSE3, CPU_SSE41, CPU_SSE42, CPU_POPCNT,
+    CPU_AVX, CPU_F16C, CPU_FMA, CPU_AVX2, CPU_BMI1, CPU_BMI2, CPU_ERMS, CPU_FSRM,
+    CPU_AVX512F, CPU_AVX512DQ, CPU_AVX512CD, CPU_AVX512BW, CPU_AVX512VL,
+    CPU_AVX512IFMA, CPU_AVX512VBMI, CPU_AVX512VNNI, CPU_AVX512BF16, CPU_AVX512FP16,
+    CPU_AMX_TILE, CPU_AMX_INT8, CPU_AMX_BF16,
+    CPU_FEATURE_COUNT
+};
+
+const char* const CPU_FEATURE_NAMES[CPU_FEATURE_COUNT] = {
+    "SSE2", "SSE3", "SSSE3", "SSE4.1", "SSE4.2", "POPCNT",
+    "AVX", "F16C", "FMA", "AVX2", "BMI1", "BMI2", "ERMS", "FSRM",
+    "AVX512F", "AVX512DQ", "AVX512CD", "AVX512BW", "AVX512VL",
+    "AVX512IFMA", "AVX512VBMI", "AVX512VNNI", "AVX512BF16", "AVX512FP16",
+    "AMX-TILE", "AMX-INT8", "AMX-BF16"
+};
+
+typedef uint64_t FeatureMask;
+
+inline constexpr FeatureMask feature_bit(CpuFeature feature) {
+    return FeatureMask(1) << feature;
+}
+
+// What each ISA_* attribute above needs at run time.
+const FeatureMask NEEDS_SSE42  = feature_bit(CPU_SSE42);
+const FeatureMask NEEDS_POPCNT = feature_bit(CPU_POPCNT);
+const FeatureMask NEEDS_BMI2   = feature_bit(CPU_BMI2);
+const FeatureMask NEEDS_AVX    = feature_bit(CPU_AVX);
+const FeatureMask NEEDS_FMA    = feature_bit(CPU_FMA) | feature_bit(CPU_AVX);
+const FeatureMask NEEDS_AVX2   = feature_bit(CPU_AVX2) | feature_bit(CPU_AVX);
+const FeatureMask NEEDS_AVX512 = feature_bit(CPU_AVX512F) | feature_bit(CPU_AVX512DQ) |
+                                 feature_bit(CPU_AVX512BW) | feature_bit(CPU_AVX512VL);
+
+struct CpuInfo {
+    std::string vendor;
+    std::string brand;
+    int family = 0;
+    int model = 0;
+    int stepping = 0;
+    int max_leaf = 0;
+
+    FeatureMask hardware = 0;  // reported by cpuid
+    FeatureMask features = 0;  // reported by cpuid and enabled by the OS
+
+    bool os_xsave = false;
+    uint64_t xcr0 = 0;             // register state the OS saves
+    uint64_t xcr0_supported = 0;   // leaf 0xD.0: state the CPU can save
+    uint32_t xsave_size = 0;       // leaf 0xD.0 EBX: XSAVE area for enabled state
+    bool xsaveopt = false, xsavec = false, xsaves = false;
+
+    bool has(CpuFeature feature) const { return (features & feature_bit(feature)) != 0; }
+    bool supports(FeatureMask required) const { return (features & required) == required; }
+};
+
+inline CpuInfo detect_cpu() {
+    CpuInfo info;
+    int r[4];
+
+    cpuid(0, 0, r);
+    info.max_leaf = r[0];
+    char vendor[13] = {};
+    std::memcpy(vendor, &r[1], 4);
+    std::memcpy(vendor + 4, &r[3], 4);
+    std::memcpy(vendor + 8, &r[2], 4);
+    info.vendor = vendor;
+
+    cpuid(0x80000000, 0, r);
+    if (unsigned(r[0]) >= 0x80000004) {
+        char brand[0x40];
+        std::memset(brand, 0, sizeof(brand));
+        for (int i = 0; i < 3; i++) {
+            cpuid(0x80000002 + i, 0, r);
+            std::memcpy(brand + 16 * i, r, sizeof(r));
+        }
+        info.brand = brand;
+        size_t first = info.brand.find_first_not_of(' ');
+        info.brand = first == std::string::npos ? "" : info.brand.substr(first);
+    }
+
+    cpuid(1, 0, r);
+    int base_family = (r[0] >> 8) & 0xf;
+    info.family = base_family == 0xf ? base_family + ((r[0] >> 20) & 0xff) : base_family;
+    info.model = (r[0] >> 4) & 0xf;
+    if (base_family == 0x6 || base_family == 0xf)
+        info.model += (r[0] >> 12) & 0xf0;
+    info.stepping = r[0] & 0xf;
+
+    auto set = [&](CpuFeature f, int reg, int bit) {
+        if ((reg >> bit) & 1)
+            info.hardware |= feature_bit(f);
+    };
+    set(CPU_SSE2, r[3], 26);
+    set(CPU_SSE3, r[2], 0);
+    set(CPU_SSSE3, r[2], 9);
+    set(CPU_SSE41, r[2], 19);
+    set(CPU_SSE42, r[2], 20);
+    set(CPU_POPCNT, r[2], 23);
+    set(CPU_AVX, r[2], 28);
+    set(CPU_F16C, r[2], 29);
+    set(CPU_FMA, r[2], 12);
+    info.os_xsave = (r[2] >> 27) & 1;
+
+    if (info.max_leaf >= 7) {
+        cpuid(7, 0, r);
+        set(CPU_BMI1, r[1], 3);
+        set(CPU_AVX2, r[1], 5);
+        set(CPU_BMI2, r[1], 8);
+        set(CPU_ERMS, r[1], 9);
+        set(CPU_AVX512F, r[1], 16);
+        set(CPU_AVX512DQ, r[1], 17);
+        set(CPU_AVX512IFMA, r[1], 21);
+        set(CPU_AVX512CD, r[1], 28);
+        set(CPU_AVX512BW, r[1], 30);
+        set(CPU_AVX512VL, r[1], 31);
+        set(CPU_AVX512VBMI, r[2], 1);
+        set(CPU_AVX512VNNI, r[2], 11);
+        set(CPU_FSRM, r[3], 4);
+        set(CPU_AMX_BF16, r[3], 22);
+        set(CPU_AVX512FP16, r[3], 23);
+        set(CPU_AMX_TILE, r[3], 24);
+        set(CPU_AMX_INT8, r[3], 25);
+        int max_subleaf = r[0];
+        if (max_subleaf >= 1) {
+            cpuid(7, 1, r);
+            set(CPU_AVX512BF16, r[0], 5);
+        }
+    }
+
+    if (info.max_leaf >= 0xD) {
+        cpuid(0xD, 0, r);
+        info.xcr0_supported = (uint64_t(uint32_t(r[3])) << 32) | uint32_t(r[0]);
+        info.xsave_size = r[1];
+        cpuid(0xD, 1, r);
+        info.xsaveopt = r[0] & 1;
+        info.xsavec = (r[0] >> 1) & 1;
+        info.xsaves = (r[0] >> 3) & 1;
+    }
+
+    // XCR0 bits: 1 SSE, 2 AVX, 5-7 opmask/ZMM state, 17-18 AMX tile state.
+    if (info.os_xsave)
+        info.xcr0 = xgetbv(0);
+    bool os_avx = (info.xcr0 & 0x6) == 0x6;
+    bool os_avx512 = os_avx && (info.xcr0 & 0xe0) == 0xe0;
+    bool os_amx = (info.xcr0 & 0x60000) == 0x60000;
+
+    FeatureMask avx_state = feature_bit(CPU_AVX) | feature_bit(CPU_F16C) | feature_bit(CPU_FMA) |
+                            feature_bit(CPU_AVX2);
+    FeatureMask avx512_state = 0;
+    for (int f = CPU_AVX512F; f <= CPU_AVX512FP16; f++)
+        avx512_state |= feature_bit(CpuFeature(f));
+    FeatureMask amx_state = feature_bit(CPU_AMX_TILE) | feature_bit(CPU_AMX_INT8) | feature_bit(CPU_AMX_BF16);
+
+    info.features = info.hardware;
+    if (!os_avx)
+        info.features &= ~avx_state;
+    if (!os_avx512)
+        info.features &= ~avx512_state;
+    if (!os_amx)
+        info.features &= ~amx_state;
+    return info;
+}
+
+// Detected once per process.
+inline const CpuInfo& cpu_info() {
+    static const CpuInfo info = detect_cpu();
+    return info;
+}
+
+inline std::string feature_list(FeatureMask mask) {
+    std::string text;
+    for (int f = 0; f < CPU_FEATURE_COUNT; f++) {
+        if (mask & feature_bit(CpuFeature(f)))
+            text += (text.empty() ? "" : " ") + std::string(CPU_FEATURE_NAMES[f]);
+    }
+    return text;
+}
+
+//------------------------//
+// Dispatch tables
+//------------------------//
+
+// A dispatch table is an array of entries with a `required` FeatureMask,
+// listed narrowest ISA first. Benchmarks run every supported entry, or the
+// widest one when a single kernel is needed.
+template <typename Entry, size_t N>
+std::vector<Entry> supported_entries(const Entry (&table)[N]) {
+    std::vector<Entry> entries;
+    for (const Entry& e : table)
+        if (cpu_info().supports(e.required))
+            entries.push_back(e);
+    return entries;
+}
+
+template <typename Entry, size_t N>
+const Entry& widest_entry(const Entry (&table)[N]) {
+    for (size_t i = N; i-- > 1;)
+        if (cpu_info().supports(table[i].required))
+            return table[i];
+    return table[0];
+}
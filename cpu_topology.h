@@ -0,0 +1,340 @@
+#pragma once
+
+// Cache hierarchy and core/node layout of the host. Caches come from cpuid
+// (leaf 4 on Intel, 0x8000001D on AMD) and are cross-checked against
+// /sys/devices/system/cpu/cpu*/cache, which also gives the CPUs sharing each
+// instance; logical CPUs, cores and nodes come from affinity.h. Benchmarks
+// size their working sets from this instead of hard-coding them.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "affinity.h"
+#include "cpu_info.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+struct CacheLevel {
+    int level = 0;
+    std::string type;       // "Data", "Instruction" or "Unified"
+    size_t size = 0;        // bytes per instance
+    int line_size = 0;
+    int ways = 0;
+    int sets = 0;
+    int cpuid_sharing = 0;  // cpuid: most logical CPUs that can share one instance
+    std::vector<std::vector<int>> instances;  // sysfs: CPUs of each instance
+    std::string source;     // "cpuid+sysfs", "cpuid" or "sysfs"
+    std::string mismatch;   // where cpuid and sysfs disagree; sysfs wins
+
+    bool holds_data() const { return type != "Instruction"; }
+
+    // Logical CPUs per instance, from sysfs when it was readable.
+    int sharing() const {
+        if (!instances.empty())
+            return std::max<int>(1, instances[0].size());
+        return std::max(1, cpuid_sharing);
+    }
+};
+
+// Cache parameters as cpuid reports them for the calling CPU. Leaf 4 and
+// 0x8000001D share one layout: EAX type/level/sharing, EBX line size,
+// partitions and ways, ECX sets.
+inline std::vector<CacheLevel> read_cpuid_caches() {
+    std::vector<CacheLevel> caches;
+    const CpuInfo& info = cpu_info();
+    int r[4];
+    int leaf = 0;
+    if (info.vendor == "GenuineIntel" && info.max_leaf >= 4) {
+        leaf = 4;
+    } else if (info.vendor == "AuthenticAMD" || info.vendor == "HygonGenuine") {
+        cpuid(0x80000000, 0, r);
+        if (unsigned(r[0]) >= 0x8000001D) {
+            cpuid(0x80000001, 0, r);
+            if ((r[2] >> 22) & 1)  // TopologyExtensions
+                leaf = 0x8000001D;
+        }
+    }
+    if (!leaf)
+        return caches;
+
+    const char* types[] = { "", "Data", "Instruction", "Unified" };
+    for (int index = 0; index < 16; index++) {
+        cpuid(leaf, index, r);
+        int type = r[0] & 0x1f;
+        if (type == 0 || type > 3)
+            break;
+        CacheLevel c;
+        c.level = (r[0] >> 5) & 0x7;
+        c.type = types[type];
+        c.cpuid_sharing = ((r[0] >> 14) & 0xfff) + 1;
+        c.line_size = (r[1] & 0xfff) + 1;
+        int partitions = ((r[1] >> 12) & 0x3ff) + 1;
+        c.ways = ((unsigned(r[1]) >> 22) & 0x3ff) + 1;
+        c.sets = r[2] + 1;
+        c.size = size_t(c.ways) * partitions * c.line_size * c.sets;
+        c.source = "cpuid";
+        caches.push_back(c);
+    }
+    return caches;
+}
+
+// "48K", "2048K", "32M" as bytes.
+inline size_t parse_cache_size(const std::string& text) {
+    size_t size = std::strtoull(text.c_str(), nullptr, 10);
+    if (text.find('K') != std::string::npos) size *= 1024;
+    if (text.find('M') != std::string::npos) size *= 1024 * 1024;
+    if (text.find('G') != std::string::npos) size *= 1024ULL * 1024 * 1024;
+    return size;
+}
+
+// Cache parameters the kernel reports, with every distinct sharing set
+// collected over all online CPUs.
+inline std::vector<CacheLevel> read_sysfs_caches(const std::vector<LogicalCpu>& cpus) {
+    std::vector<CacheLevel> caches;
+    for (const LogicalCpu& cpu : cpus) {
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu.cpu) + "/cache/index";
+        for (int index = 0; index < 16; index++) {
+            std::string base = dir + std::to_string(index) + "/";
+            int level = read_sysfs_int(base + "level", 0);
+            if (level == 0)
+                break;
+            std::string type = read_sysfs_line(base + "type");
+            auto found = std::find_if(caches.begin(), caches.end(), [&](const CacheLevel& c) {
+                return c.level == level && c.type == type;
+            });
+            if (found == caches.end()) {
+                CacheLevel c;
+                c.level = level;
+                c.type = type;
+                c.size = parse_cache_size(read_sysfs_line(base + "size"));
+                c.line_size = read_sysfs_int(base + "coherency_line_size", 0);
+                c.ways = read_sysfs_int(base + "ways_of_associativity", 0);
+                c.sets = read_sysfs_int(base + "number_of_sets", 0);
+                c.source = "sysfs";
+                caches.push_back(c);
+                found = caches.end() - 1;
+            }
+            std::vector<int> shared = parse_cpu_list(read_sysfs_line(base + "shared_cpu_list"));
+            if (!shared.empty() &&
+                std::find(found->instances.begin(), found->instances.end(), shared) == found->instances.end())
+                found->instances.push_back(shared);
+        }
+    }
+    return caches;
+}
+
+// sysfs describes every CPU and what the OS actually uses, so its values
+// win; cpuid fills in what sysfs lacks. A disagreement usually means a
+// hybrid part (cpuid ran on a different core type than cpu0) or a
+// hypervisor filtering one of the two.
+inline std::vector<CacheLevel> merge_caches(const std::vector<CacheLevel>& from_cpuid,
+                                            std::vector<CacheLevel> from_sysfs) {
+    for (const CacheLevel& c : from_cpuid) {
+        auto found = std::find_if(from_sysfs.begin(), from_sysfs.end(), [&](const CacheLevel& s) {
+            return s.level == c.level && s.type == c.type;
+        });
+        if (found == from_sysfs.end()) {
+            from_sysfs.push_back(c);
+            continue;
+        }
+        CacheLevel& s = *found;
+        s.source = "cpuid+sysfs";
+        s.cpuid_sharing = c.cpuid_sharing;
+        auto check = [&](const char* field, size_t cpuid_value, size_t sysfs_value) {
+            if (sysfs_value && cpuid_value != sysfs_value)
+                s.mismatch += std::string(s.mismatch.empty() ? "" : ", ") + field + " cpuid " +
+                              std::to_string(cpuid_value) + " vs sysfs " + std::to_string(sysfs_value);
+        };
+        check("size", c.size, s.size);
+        check("line", c.line_size, s.line_size);
+        check("ways", c.ways, s.ways);
+        if (!s.size) s.size = c.size;
+        if (!s.line_size) s.line_size = c.line_size;
+        if (!s.ways) s.ways = c.ways;
+        if (!s.sets) s.sets = c.sets;
+    }
+    std::sort(from_sysfs.begin(), from_sysfs.end(), [](const CacheLevel& a, const CacheLevel& b) {
+        if (a.level != b.level) return a.level < b.level;
+        return a.type < b.type;
+    });
+    return from_sysfs;
+}
+
+inline std::string format_size(size_t bytes) {
+    const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    int unit = 0;
+    while (bytes >= 1024 && bytes % 1024 == 0 && unit < 4) {
+        bytes /= 1024;
+        unit++;
+    }
+    return std::to_string(bytes) + " " + units[unit];
+}
+
+struct CpuTopology {
+    std::vector<LogicalCpu> cpus;
+    std::vector<int> nodes;
+    int packages = 0;
+    int physical_cores = 0;
+    std::vector<CacheLevel> caches;  // by level, data before instruction
+    size_t memory_bytes = 0;         // physical memory, 0 if unknown
+
+    // The data or unified cache of one level, null if there is none.
+    const CacheLevel* data_cache(int level) const {
+        for (const CacheLevel& c : caches)
+            if (c.level == level && c.holds_data())
+                return &c;
+        return nullptr;
+    }
+
+    const CacheLevel* last_level_cache() const {
+        for (size_t i = caches.size(); i-- > 0;)
+            if (caches[i].holds_data())
+                return &caches[i];
+        return nullptr;
+    }
+
+    // L1D line size; 64 bytes when nothing reports one.
+    int line_size() const {
+        const CacheLevel* l1 = data_cache(1);
+        return l1 && l1->line_size ? l1->line_size : 64;
+    }
+
+    // Data cache capacity of the whole machine, every instance counted.
+    size_t total_cache() const {
+        size_t total = 0;
+        for (const CacheLevel& c : caches) {
+            if (!c.holds_data())
+                continue;
+            size_t count = c.instances.empty() ? std::max<size_t>(1, cpus.size() / c.sharing()) : c.instances.size();
+            total += c.size * count;
+        }
+        return total;
+    }
+
+    // A buffer that is served from memory rather than cache: four times all
+    // caches together (the STREAM rule), at least 256 MiB, rounded up to a
+    // power of two and kept within an eighth of physical memory so STREAM's
+    // three arrays still fit comfortably.
+    size_t memory_working_set() const {
+        size_t target = std::max<size_t>(4 * total_cache(), 256ULL << 20);
+        size_t size = 1;
+        while (size < target)
+            size <<= 1;
+        if (memory_bytes)
+            while (size > (256ULL << 20) && size > memory_bytes / 8)
+                size >>= 1;
+        return size;
+    }
+
+    // Smallest data cache level holding `bytes_per_thread` for each of
+    // `threads` threads spread evenly over its instances, e.g. "L2"; "DRAM"
+    // when none does.
+    std::string fitting_level(size_t bytes_per_thread, int threads) const {
+        for (const CacheLevel& c : caches) {
+            if (!c.holds_data())
+                continue;
+            int count = c.instances.empty() ? std::max<int>(1, cpus.size() / c.sharing()) : c.instances.size();
+            int per_instance = std::min(c.sharing(), (threads + count - 1) / count);
+            if (bytes_per_thread * std::max(1, per_instance) <= c.size)
+                return "L" + std::to_string(c.level);
+        }
+        return "DRAM";
+    }
+
+    // Hardware threads of the core `cpu` belongs to, itself included.
+    std::vector<int> smt_siblings(int cpu) const {
+        std::vector<int> siblings;
+        auto self = std::find_if(cpus.begin(), cpus.end(), [&](const LogicalCpu& c) { return c.cpu == cpu; });
+        if (self == cpus.end())
+            return siblings;
+        for (const LogicalCpu& c : cpus)
+            if (c.package == self->package && c.core == self->core)
+                siblings.push_back(c.cpu);
+        return siblings;
+    }
+
+    // The first hardware thread of every physical core.
+    std::vector<int> one_per_core() const {
+        std::vector<int> result;
+        for (const LogicalCpu& c : cpus)
+            if (c.smt_rank == 0)
+                result.push_back(c.cpu);
+        return result;
+    }
+
+    int threads_per_core() const {
+        return physical_cores ? std::max<int>(1, cpus.size() / physical_cores) : 1;
+    }
+};
+
+inline CpuTopology detect_topology() {
+    CpuTopology t;
+    t.cpus = read_cpu_topology();
+    t.nodes = topology_nodes(t.cpus);
+    std::vector<std::pair<int, int>> cores;
+    std::vector<int> packages;
+    for (const LogicalCpu& c : t.cpus) {
+        if (std::find(cores.begin(), cores.end(), std::make_pair(c.package, c.core)) == cores.end())
+            cores.push_back(std::make_pair(c.package, c.core));
+        if (std::find(packages.begin(), packages.end(), c.package) == packages.end())
+            packages.push_back(c.package);
+    }
+    t.physical_cores = cores.size();
+    t.packages = packages.size();
+    t.caches = merge_caches(read_cpuid_caches(), read_sysfs_caches(t.cpus));
+#ifdef __linux__
+    long pages = sysconf(_SC_PHYS_PAGES), page_size = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page_size > 0)
+        t.memory_bytes = size_t(pages) * size_t(page_size);
+#endif
+    return t;
+}
+
+// Detected once per process.
+inline const CpuTopology& cpu_topology() {
+    static const CpuTopology topology = detect_topology();
+    return topology;
+}
+
+// 1, 2, 4, ... and finally every placed thread.
+inline std::vector<int> sweep_thread_counts(int max_threads) {
+    std::vector<int> counts;
+    for (int threads = 1; threads < max_threads; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(max_threads);
+    // With the default placement the first physical_cores threads get a
+    // core each, so that count marks where SMT siblings start sharing.
+    int cores = cpu_topology().physical_cores;
+    if (cores > 1 && cores < max_threads && std::find(counts.begin(), counts.end(), cores) == counts.end())
+        counts.insert(std::lower_bound(counts.begin(), counts.end(), cores), cores);
+    return counts;
+}
+
+// One line per cache level and the core/node layout, for the program headers.
+inline std::string describe_topology(const CpuTopology& t) {
+    std::ostringstream text;
+    text << "Topology: " << t.packages << " package" << (t.packages > 1 ? "s" : "") << ", "
+         << t.physical_cores << " core" << (t.physical_cores > 1 ? "s" : "") << ", "
+         << t.cpus.size() << " logical CPU" << (t.cpus.size() > 1 ? "s" : "") << " ("
+         << t.threads_per_core() << " per core), " << t.nodes.size() << " NUMA node"
+         << (t.nodes.size() > 1 ? "s" : "");
+    if (t.memory_bytes)
+        text << ", " << format_size(t.memory_bytes / (1 << 20) << 20) << " memory";
+    for (const CacheLevel& c : t.caches) {
+        text << "\n  L" << c.level << " " << c.type << ": " << format_size(c.size) << ", "
+             << c.line_size << " B lines, " << c.ways << "-way, " << c.sets << " sets, shared by "
+             << c.sharing() << " CPU" << (c.sharing() > 1 ? "s" : "");
+        if (!c.instances.empty())
+            text << " x " << c.instances.size() << " instance" << (c.instances.size() > 1 ? "s" : "");
+        text << " [" << c.source << "]";
+        if (!c.mismatch.empty())
+            text << " (differs: " << c.mismatch << ")";
+    }
+    return text.str();
+}
@@ -0,0 +1,386 @@
+#include <iostream>
+#include <iomanip>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <immintrin.h>
+
+#include "affinity.h"
+#include "bench_args.h"
+#include "bench_report.h"
+#include "bench_stats.h"
+#include "cpu_clock.h"
+#include "cpu_info.h"
+#include "perf_counters.h"
+#include "worker_pool.h"
+
+constexpr uint64_t ITERATIONS = 1 << 21; // loop iterations per sample, one instruction per chain each
+std::vector<int> thread_cpus; // CPU for the measuring worker, from --affinity
+BenchReport report; // --json/--csv/--compare
+PoolCounters perf;  // core cycles of the worker, when permitted
+
+// Gather tables hold their own indices, so a gathered vector is the index
+// vector of the next gather. Lanes start one cache line apart.
+alignas(64) int32_t GATHER_TABLE32[4096];
+alignas(64) int64_t GATHER_TABLE64[4096];
+
+//------------------------//
+// Operations
+//------------------------//
+
+// One instruction at one element type and register width. apply() computes
+// the next value of a chain from the previous one and a loop-invariant
+// operand x; conversions feed their result back through a cast, which costs
+// no instruction. `reg` is the asm constraint for the register class ("r"
+// for general-purpose, "v" for vector), used to hide values from the
+// optimizer without adding instructions.
+#define INSTR_OP(name, isa, vec_t, reg, init_expr, operand_expr, apply_expr) \
+    struct name {                                                           \
+        typedef vec_t vec;                                                  \
+        isa static vec init(int chain) { (void)chain; return init_expr; }   \
+        isa static vec operand() { return operand_expr; }                   \
+        isa static vec apply(vec acc, vec x) { (void)x; return apply_expr; } \
+        isa static void hide(vec& v) { __asm__ ("" : "+" reg (v)); }        \
+        isa static void sink(vec v) { __asm__ volatile ("" :: reg (v)); }   \
+    };
+
+// General-purpose registers. Division keeps a full 64-bit (32-bit) quotient
+// by dividing by 1, which the compiler can't see through.
+INSTR_OP(imul_r64,     ,           uint64_t, "r", 0x0123456789abcdefULL + chain, 3, acc * x)
+INSTR_OP(div_r64,      ,           uint64_t, "r", 0x0123456789abcdefULL + chain, 1, acc / x)
+INSTR_OP(div_r32,      ,           uint32_t, "r", 0x89abcdefU + chain, 1, acc / x)
+INSTR_OP(shl_r64_cl,   ,           uint64_t, "r", 0x0123456789abcdefULL + chain, 5, acc << (x & 63))
+INSTR_OP(shlx_r64,     ISA_BMI2,   uint64_t, "r", 0x0123456789abcdefULL + chain, 5, acc << (x & 63))
+INSTR_OP(popcnt_r64,   ISA_POPCNT, uint64_t, "r", 0x0123456789abcdefULL + chain, 0, uint64_t(_mm_popcnt_u64(acc)))
+
+// Scalar and 128-bit SSE.
+INSTR_OP(mulsd,        ISA_SSE42, __m128d, "v", _mm_set1_pd(1.5 + chain), _mm_set1_pd(1.0), _mm_mul_sd(acc, x))
+INSTR_OP(divsd,        ISA_SSE42, __m128d, "v", _mm_set1_pd(1.5 + chain), _mm_set1_pd(1.0), _mm_div_sd(acc, x))
+INSTR_OP(sqrtsd,       ISA_SSE42, __m128d, "v", _mm_set1_pd(1.5 + chain), _mm_set1_pd(1.0), _mm_sqrt_sd(acc, acc))
+INSTR_OP(mulps,        ISA_SSE42, __m128,  "v", _mm_set1_ps(1.5f + chain), _mm_set1_ps(1.0f), _mm_mul_ps(acc, x))
+INSTR_OP(divps,        ISA_SSE42, __m128,  "v", _mm_set1_ps(1.5f + chain), _mm_set1_ps(1.0f), _mm_div_ps(acc, x))
+INSTR_OP(divpd,        ISA_SSE42, __m128d, "v", _mm_set1_pd(1.5 + chain), _mm_set1_pd(1.0), _mm_div_pd(acc, x))
+INSTR_OP(sqrtps,       ISA_SSE42, __m128,  "v", _mm_set1_ps(1.5f + chain), _mm_set1_ps(1.0f), _mm_sqrt_ps(acc))
+INSTR_OP(sqrtpd,       ISA_SSE42, __m128d, "v", _mm_set1_pd(1.5 + chain), _mm_set1_pd(1.0), _mm_sqrt_pd(acc))
+INSTR_OP(pmulld,       ISA_SSE42, __m128i, "v", _mm_set1_epi32(12345 + chain), _mm_set1_epi32(3), _mm_mullo_epi32(acc, x))
+INSTR_OP(pmuludq,      ISA_SSE42, __m128i, "v", _mm_set1_epi32(12345 + chain), _mm_set1_epi32(3), _mm_mul_epu32(acc, x))
+INSTR_OP(pslld_imm,    ISA_SSE42, __m128i, "v", _mm_set1_epi32(12345 + chain), _mm_setzero_si128(), _mm_slli_epi32(acc, 1))
+INSTR_OP(pslld_xmm,    ISA_SSE42, __m128i, "v", _mm_set1_epi32(12345 + chain), _mm_cvtsi32_si128(1), _mm_sll_epi32(acc, x))
+INSTR_OP(shufps,       ISA_SSE42, __m128,  "v", _mm_set1_ps(1.5f + chain), _mm_setzero_ps(), _mm_shuffle_ps(acc, acc, 0x1b))
+INSTR_OP(pshufb,       ISA_SSE42, __m128i, "v", _mm_set1_epi32(12345 + chain),
+         _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0), _mm_shuffle_epi8(acc, x))
+INSTR_OP(cvtdq2ps,     ISA_SSE42, __m128i, "v", _mm_set1_epi32(12345 + chain), _mm_setzero_si128(),
+         _mm_castps_si128(_mm_cvtepi32_ps(acc)))
+INSTR_OP(cvtps2dq,     ISA_SSE42, __m128,  "v", _mm_set1_ps(1.5f + chain), _mm_setzero_ps(),
+         _mm_castsi128_ps(_mm_cvtps_epi32(acc)))
+INSTR_OP(cvtps2pd,     ISA_SSE42, __m128,  "v", _mm_set1_ps(1.5f + chain), _mm_setzero_ps(),
+         _mm_castpd_ps(_mm_cvtps_pd(acc)))
+INSTR_OP(cvtpd2ps,     ISA_SSE42, __m128d, "v", _mm_set1_pd(1.5 + chain), _mm_setzero_pd(),
+         _mm_castps_pd(_mm_cvtpd_ps(acc)))
+
+// 256-bit AVX/AVX2.
+INSTR_OP(vmulps_ymm,   ISA_AVX,  __m256,  "v", _mm256_set1_ps(1.5f + chain), _mm256_set1_ps(1.0f), _mm256_mul_ps(acc, x))
+INSTR_OP(vdivps_ymm,   ISA_AVX,  __m256,  "v", _mm256_set1_ps(1.5f + chain), _mm256_set1_ps(1.0f), _mm256_div_ps(acc, x))
+INSTR_OP(vdivpd_ymm,   ISA_AVX,  __m256d, "v", _mm256_set1_pd(1.5 + chain), _mm256_set1_pd(1.0), _mm256_div_pd(acc, x))
+INSTR_OP(vsqrtps_ymm,  ISA_AVX,  __m256,  "v", _mm256_set1_ps(1.5f + chain), _mm256_set1_ps(1.0f), _mm256_sqrt_ps(acc))
+INSTR_OP(vsqrtpd_ymm,  ISA_AVX,  __m256d, "v", _mm256_set1_pd(1.5 + chain), _mm256_set1_pd(1.0), _mm256_sqrt_pd(acc))
+INSTR_OP(vshufps_ymm,  ISA_AVX,  __m256,  "v", _mm256_set1_ps(1.5f + chain), _mm256_setzero_ps(), _mm256_shuffle_ps(acc, acc, 0x1b))
+INSTR_OP(vperm2f128,   ISA_AVX,  __m256,  "v", _mm256_set1_ps(1.5f + chain), _mm256_setzero_ps(), _mm256_permute2f128_ps(acc, acc, 0x01))
+INSTR_OP(vcvtdq2ps_ymm, ISA_AVX, __m256i, "v", _mm256_set1_epi32(12345 + chain), _mm256_setzero_si256(),
+         _mm256_castps_si256(_mm256_cvtepi32_ps(acc)))
+INSTR_OP(vcvtps2dq_ymm, ISA_AVX, __m256,  "v", _mm256_set1_ps(1.5f + chain), _mm256_setzero_ps(),
+         _mm256_castsi256_ps(_mm256_cvtps_epi32(acc)))
+INSTR_OP(vcvtps2pd_ymm, ISA_AVX, __m256d, "v", _mm256_set1_pd(1.5 + chain), _mm256_setzero_pd(),
+         _mm256_cvtps_pd(_mm256_castps256_ps128(_mm256_castpd_ps(acc))))
+INSTR_OP(vcvtpd2ps_ymm, ISA_AVX, __m256d, "v", _mm256_set1_pd(1.5 + chain), _mm256_setzero_pd(),
+         _mm256_castps_pd(_mm256_castps128_ps256(_mm256_cvtpd_ps(acc))))
+INSTR_OP(vpmulld_ymm,  ISA_AVX2, __m256i, "v", _mm256_set1_epi32(12345 + chain), _mm256_set1_epi32(3), _mm256_mullo_epi32(acc, x))
+INSTR_OP(vpslld_ymm,   ISA_AVX2, __m256i, "v", _mm256_set1_epi32(12345 + chain), _mm256_setzero_si256(), _mm256_slli_epi32(acc, 1))
+INSTR_OP(vpsllvd_ymm,  ISA_AVX2, __m256i, "v", _mm256_set1_epi32(12345 + chain), _mm256_set1_epi32(1), _mm256_sllv_epi32(acc, x))
+INSTR_OP(vpshufb_ymm,  ISA_AVX2, __m256i, "v", _mm256_set1_epi32(12345 + chain),
+         _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                          15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0), _mm256_shuffle_epi8(acc, x))
+INSTR_OP(vpermd_ymm,   ISA_AVX2, __m256i, "v", _mm256_set1_epi32(12345 + chain),
+         _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0), _mm256_permutevar8x32_epi32(acc, x))
+INSTR_OP(vpgatherdd_xmm, ISA_AVX2, __m128i, "v", _mm_add_epi32(_mm_setr_epi32(0, 16, 32, 48), _mm_set1_epi32(chain)),
+         _mm_setzero_si128(), _mm_i32gather_epi32((const int*)GATHER_TABLE32, acc, 4))
+INSTR_OP(vpgatherdd_ymm, ISA_AVX2, __m256i, "v",
+         _mm256_add_epi32(_mm256_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112), _mm256_set1_epi32(chain)),
+         _mm256_setzero_si256(), _mm256_i32gather_epi32((const int*)GATHER_TABLE32, acc, 4))
+INSTR_OP(vpgatherqq_ymm, ISA_AVX2, __m256i, "v", _mm256_add_epi64(_mm256_setr_epi64x(0, 8, 16, 24), _mm256_set1_epi64x(chain)),
+         _mm256_setzero_si256(), _mm256_i64gather_epi64((const long long*)GATHER_TABLE64, acc, 8))
+
+// 512-bit AVX-512. Its headers build unmasked results from a self-initialized
+// _mm512_undefined_*() value, which -Wall flags once inlined into a kernel.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+INSTR_OP(vmulps_zmm,   ISA_AVX512, __m512,  "v", _mm512_set1_ps(1.5f + chain), _mm512_set1_ps(1.0f), _mm512_mul_ps(acc, x))
+INSTR_OP(vdivps_zmm,   ISA_AVX512, __m512,  "v", _mm512_set1_ps(1.5f + chain), _mm512_set1_ps(1.0f), _mm512_div_ps(acc, x))
+INSTR_OP(vdivpd_zmm,   ISA_AVX512, __m512d, "v", _mm512_set1_pd(1.5 + chain), _mm512_set1_pd(1.0), _mm512_div_pd(acc, x))
+INSTR_OP(vsqrtps_zmm,  ISA_AVX512, __m512,  "v", _mm512_set1_ps(1.5f + chain), _mm512_set1_ps(1.0f), _mm512_sqrt_ps(acc))
+INSTR_OP(vsqrtpd_zmm,  ISA_AVX512, __m512d, "v", _mm512_set1_pd(1.5 + chain), _mm512_set1_pd(1.0), _mm512_sqrt_pd(acc))
+INSTR_OP(vpmulld_zmm,  ISA_AVX512, __m512i, "v", _mm512_set1_epi32(12345 + chain), _mm512_set1_epi32(3), _mm512_mullo_epi32(acc, x))
+INSTR_OP(vpmullq_zmm,  ISA_AVX512, __m512i, "v", _mm512_set1_epi64(12345 + chain), _mm512_set1_epi64(3), _mm512_mullo_epi64(acc, x))
+INSTR_OP(vpsllvd_zmm,  ISA_AVX512, __m512i, "v", _mm512_set1_epi32(12345 + chain), _mm512_set1_epi32(1), _mm512_sllv_epi32(acc, x))
+INSTR_OP(vpshufb_zmm,  ISA_AVX512, __m512i, "v", _mm512_set1_epi32(12345 + chain),
+         _mm512_broadcast_i32x4(_mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)),
+         _mm512_shuffle_epi8(acc, x))
+INSTR_OP(vpermd_zmm,   ISA_AVX512, __m512i, "v", _mm512_set1_epi32(12345 + chain),
+         _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0), _mm512_permutexvar_epi32(x, acc))
+INSTR_OP(vcvtdq2ps_zmm, ISA_AVX512, __m512i, "v", _mm512_set1_epi32(12345 + chain), _mm512_setzero_si512(),
+         _mm512_castps_si512(_mm512_cvtepi32_ps(acc)))
+INSTR_OP(vcvtps2dq_zmm, ISA_AVX512, __m512,  "v", _mm512_set1_ps(1.5f + chain), _mm512_setzero_ps(),
+         _mm512_castsi512_ps(_mm512_cvtps_epi32(acc)))
+INSTR_OP(vcvtps2pd_zmm, ISA_AVX512, __m512d, "v", _mm512_set1_pd(1.5 + chain), _mm512_setzero_pd(),
+         _mm512_cvtps_pd(_mm512_castps512_ps256(_mm512_castpd_ps(acc))))
+INSTR_OP(vcvtpd2ps_zmm, ISA_AVX512, __m512d, "v", _mm512_set1_pd(1.5 + chain), _mm512_setzero_pd(),
+         _mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(acc))))
+INSTR_OP(vpgatherdd_zmm, ISA_AVX512, __m512i, "v",
+         _mm512_add_epi32(_mm512_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240),
+                          _mm512_set1_epi32(chain)),
+         _mm512_setzero_si512(), _mm512_i32gather_epi32(acc, (const int*)GATHER_TABLE32, 4))
+INSTR_OP(vpgatherqq_zmm, ISA_AVX512, __m512i, "v",
+         _mm512_add_epi64(_mm512_setr_epi64(0, 8, 16, 24, 32, 40, 48, 56), _mm512_set1_epi64(chain)),
+         _mm512_setzero_si512(), _mm512_i64gather_epi64(acc, (const long long*)GATHER_TABLE64, 8))
+#pragma GCC diagnostic pop
+
+//------------------------//
+// Chain kernels
+//------------------------//
+
+// `Chains` independent dependency chains, advanced once per iteration. One
+// chain measures latency: every instruction waits for the previous result.
+// Enough chains to cover latency x ports measure reciprocal throughput. As
+// in cpu_bench_2, one copy per target level so the intrinsics inline.
+#define DEFINE_INSTR_KERNEL(name, isa)                                      \
+    template <typename Op, int Chains>                                      \
+    isa void name(uint64_t iterations) {                                    \
+        typename Op::vec acc[Chains];                                       \
+        typename Op::vec x = Op::operand();                                 \
+        Op::hide(x);                                                        \
+        _Pragma("GCC unroll 32")                                            \
+        for (int u = 0; u < Chains; u++)                                    \
+            acc[u] = Op::init(u);                                           \
+        for (uint64_t i = 0; i < iterations; i++) {                         \
+            _Pragma("GCC unroll 32")                                        \
+            for (int u = 0; u < Chains; u++) {                              \
+                acc[u] = Op::apply(acc[u], x);                              \
+                Op::hide(acc[u]);                                           \
+            }                                                               \
+        }                                                                   \
+        _Pragma("GCC unroll 32")                                            \
+        for (int u = 0; u < Chains; u++)                                    \
+            Op::sink(acc[u]);                                               \
+    }
+
+DEFINE_INSTR_KERNEL(instr_kernel_base, )
+DEFINE_INSTR_KERNEL(instr_kernel_sse, ISA_SSE42)
+DEFINE_INSTR_KERNEL(instr_kernel_popcnt, ISA_POPCNT)
+DEFINE_INSTR_KERNEL(instr_kernel_bmi2, ISA_BMI2)
+DEFINE_INSTR_KERNEL(instr_kernel_avx, ISA_AVX)
+DEFINE_INSTR_KERNEL(instr_kernel_avx2, ISA_AVX2)
+DEFINE_INSTR_KERNEL(instr_kernel_avx512, ISA_AVX512)
+
+// Throughput chains per register file: 8 of the 16 general-purpose
+// registers leave room for the loop and operands, 12 of 16 vector registers
+// as in the peak kernels, 24 of the 32 AVX-512 registers.
+const int CHAINS_GPR = 8;
+const int CHAINS = 12;
+const int CHAINS_AVX512 = 24;
+
+struct InstrKernel {
+    const char* instr;   // uops.info-style mnemonic and operands
+    const char* isa;
+    const char* type;
+    int width;           // register width in bits
+    int chains;          // independent chains for the throughput run
+    FeatureMask required;
+    void (*latency)(uint64_t iterations);
+    void (*throughput)(uint64_t iterations);
+};
+
+#define INSTR_KERNEL(instr, isa, type, width, Op, required, kernel, chains) \
+    { instr, isa, type, width, chains, required, kernel<Op, 1>, kernel<Op, chains> }
+
+const InstrKernel INSTR_KERNELS[] = {
+    INSTR_KERNEL("IMUL r64, r64",         "x86",     "int64",  64,  imul_r64,       0,            instr_kernel_base,   CHAINS_GPR),
+    INSTR_KERNEL("DIV r64",               "x86",     "int64",  64,  div_r64,        0,            instr_kernel_base,   CHAINS_GPR),
+    INSTR_KERNEL("DIV r32",               "x86",     "int32",  32,  div_r32,        0,            instr_kernel_base,   CHAINS_GPR),
+    INSTR_KERNEL("SHL r64, CL",           "x86",     "int64",  64,  shl_r64_cl,     0,            instr_kernel_base,   CHAINS_GPR),
+    INSTR_KERNEL("SHLX r64, r64, r64",    "BMI2",    "int64",  64,  shlx_r64,       NEEDS_BMI2,   instr_kernel_bmi2,   CHAINS_GPR),
+    INSTR_KERNEL("POPCNT r64, r64",       "POPCNT",  "int64",  64,  popcnt_r64,     NEEDS_POPCNT, instr_kernel_popcnt, CHAINS_GPR),
+    INSTR_KERNEL("MULSD xmm, xmm",        "SSE",     "double", 64,  mulsd,          NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("DIVSD xmm, xmm",        "SSE",     "double", 64,  divsd,          NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("SQRTSD xmm, xmm",       "SSE",     "double", 64,  sqrtsd,         NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("MULPS xmm, xmm",        "SSE",     "float",  128, mulps,          NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("DIVPS xmm, xmm",        "SSE",     "float",  128, divps,          NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("DIVPD xmm, xmm",        "SSE",     "double", 128, divpd,          NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("SQRTPS xmm, xmm",       "SSE",     "float",  128, sqrtps,         NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("SQRTPD xmm, xmm",       "SSE",     "double", 128, sqrtpd,         NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("PMULLD xmm, xmm",       "SSE",     "int32",  128, pmulld,         NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("PMULUDQ xmm, xmm",      "SSE",     "int64",  128, pmuludq,        NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("PSLLD xmm, imm8",       "SSE",     "int32",  128, pslld_imm,      NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("PSLLD xmm, xmm",        "SSE",     "int32",  128, pslld_xmm,      NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("SHUFPS xmm, xmm, imm8", "SSE",     "float",  128, shufps,         NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("PSHUFB xmm, xmm",       "SSE",     "int8",   128, pshufb,         NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("CVTDQ2PS xmm, xmm",     "SSE",     "int32",  128, cvtdq2ps,       NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("CVTPS2DQ xmm, xmm",     "SSE",     "float",  128, cvtps2dq,       NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("CVTPS2PD xmm, xmm",     "SSE",     "float",  128, cvtps2pd,       NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("CVTPD2PS xmm, xmm",     "SSE",     "double", 128, cvtpd2ps,       NEEDS_SSE42,  instr_kernel_sse,    CHAINS),
+    INSTR_KERNEL("VMULPS ymm, ymm, ymm",  "AVX",     "float",  256, vmulps_ymm,     NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VDIVPS ymm, ymm, ymm",  "AVX",     "float",  256, vdivps_ymm,     NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VDIVPD ymm, ymm, ymm",  "AVX",     "double", 256, vdivpd_ymm,     NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VSQRTPS ymm, ymm",      "AVX",     "float",  256, vsqrtps_ymm,    NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VSQRTPD ymm, ymm",      "AVX",     "double", 256, vsqrtpd_ymm,    NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VSHUFPS ymm, ymm, ymm, imm8", "AVX", "float", 256, vshufps_ymm,   NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VPERM2F128 ymm, ymm, ymm, imm8", "AVX", "float", 256, vperm2f128, NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VCVTDQ2PS ymm, ymm",    "AVX",     "int32",  256, vcvtdq2ps_ymm,  NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VCVTPS2DQ ymm, ymm",    "AVX",     "float",  256, vcvtps2dq_ymm,  NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VCVTPS2PD ymm, xmm",    "AVX",     "float",  256, vcvtps2pd_ymm,  NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VCVTPD2PS xmm, ymm",    "AVX",     "double", 256, vcvtpd2ps_ymm,  NEEDS_AVX,    instr_kernel_avx,    CHAINS),
+    INSTR_KERNEL("VPMULLD ymm, ymm, ymm", "AVX2",    "int32",  256, vpmulld_ymm,    NEEDS_AVX2,   instr_kernel_avx2,   CHAINS),
+    INSTR_KERNEL("VPSLLD ymm, ymm, imm8", "AVX2",    "int32",  256, vpslld_ymm,     NEEDS_AVX2,   instr_kernel_avx2,   CHAINS),
+    INSTR_KERNEL("VPSLLVD ymm, ymm, ymm", "AVX2",    "int32",  256, vpsllvd_ymm,    NEEDS_AVX2,   instr_kernel_avx2,   CHAINS),
+    INSTR_KERNEL("VPSHUFB ymm, ymm, ymm", "AVX2",    "int8",   256, vpshufb_ymm,    NEEDS_AVX2,   instr_kernel_avx2,   CHAINS),
+    INSTR_KERNEL("VPERMD ymm, ymm, ymm",  "AVX2",    "int32",  256, vpermd_ymm,     NEEDS_AVX2,   instr_kernel_avx2,   CHAINS),
+    INSTR_KERNEL("VPGATHERDD xmm, [vsib xmm], xmm", "AVX2", "int32", 128, vpgatherdd_xmm, NEEDS_AVX2, instr_kernel_avx2, CHAINS),
+    INSTR_KERNEL("VPGATHERDD ymm, [vsib ymm], ymm", "AVX2", "int32", 256, vpgatherdd_ymm, NEEDS_AVX2, instr_kernel_avx2, CHAINS),
+    INSTR_KERNEL("VPGATHERQQ ymm, [vsib ymm], ymm", "AVX2", "int64", 256, vpgatherqq_ymm, NEEDS_AVX2, instr_kernel_avx2, CHAINS),
+    INSTR_KERNEL("VMULPS zmm, zmm, zmm",  "AVX-512", "float",  512, vmulps_zmm,     NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VDIVPS zmm, zmm, zmm",  "AVX-512", "float",  512, vdivps_zmm,     NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VDIVPD zmm, zmm, zmm",  "AVX-512", "double", 512, vdivpd_zmm,     NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VSQRTPS zmm, zmm",      "AVX-512", "float",  512, vsqrtps_zmm,    NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VSQRTPD zmm, zmm",      "AVX-512", "double", 512, vsqrtpd_zmm,    NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VPMULLD zmm, zmm, zmm", "AVX-512", "int32",  512, vpmulld_zmm,    NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VPMULLQ zmm, zmm, zmm", "AVX-512", "int64",  512, vpmullq_zmm,    NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VPSLLVD zmm, zmm, zmm", "AVX-512", "int32",  512, vpsllvd_zmm,    NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VPSHUFB zmm, zmm, zmm", "AVX-512", "int8",   512, vpshufb_zmm,    NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VPERMD zmm, zmm, zmm",  "AVX-512", "int32",  512, vpermd_zmm,     NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VCVTDQ2PS zmm, zmm",    "AVX-512", "int32",  512, vcvtdq2ps_zmm,  NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VCVTPS2DQ zmm, zmm",    "AVX-512", "float",  512, vcvtps2dq_zmm,  NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VCVTPS2PD zmm, ymm",    "AVX-512", "float",  512, vcvtps2pd_zmm,  NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VCVTPD2PS ymm, zmm",    "AVX-512", "double", 512, vcvtpd2ps_zmm,  NEEDS_AVX512, instr_kernel_avx512, CHAINS_AVX512),
+    INSTR_KERNEL("VPGATHERDD zmm, [vsib zmm]", "AVX-512", "int32", 512, vpgatherdd_zmm, NEEDS_AVX512, instr_kernel_avx512, CHAINS),
+    INSTR_KERNEL("VPGATHERQQ zmm, [vsib zmm]", "AVX-512", "int64", 512, vpgatherqq_zmm, NEEDS_AVX512, instr_kernel_avx512, CHAINS),
+};
+
+//------------------------//
+// Measurement
+//------------------------//
+
+struct InstrResult {
+    SampleStats stats;   // seconds per sample
+    double cycles = 0;   // core cycles per instruction, from the median sample
+    double clock_hz = 0; // core clock the cycles were derived with
+};
+
+// Times `iterations` x `chains` instructions on worker 0. Cycles come from
+// the counted core cycles when there are any, otherwise from the clock
+// estimated at start-up.
+InstrResult measure_instr(WorkerPool& pool, void (*kernel)(uint64_t), int chains, double ghz,
+                          const MeasureConfig& config) {
+    double instructions = double(ITERATIONS) * chains;
+    perf.reset();
+    InstrResult r;
+    r.stats = measure(config, [&] {
+        return pool.run(1, [&](int i) {
+            perf.start(i);
+            kernel(ITERATIONS);
+            perf.stop(i);
+        });
+    });
+    CycleStats c = cycle_stats(r.stats, perf.total(1), instructions, 1);
+    r.clock_hz = c.core_ghz > 0 ? c.core_ghz * 1e9 : ghz * 1e9;
+    r.cycles = r.stats.median * r.clock_hz / instructions;
+    return r;
+}
+
+bool matches(const InstrKernel& k, const std::string& filter) {
+    auto lower = [](std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+        return text;
+    };
+    std::string needle = lower(filter);
+    return lower(k.instr).find(needle) != std::string::npos || lower(k.isa).find(needle) != std::string::npos ||
+           lower(k.type) == needle;
+}
+
+// Usage: instr_bench [filter]   latency and reciprocal throughput per instruction,
+//                               optionally only rows whose instruction or ISA contains
+//                               `filter` or whose type is `filter` (e.g. div, avx2, int64)
+// Options: --affinity=scatter|compact|physical|none|<cpu list> (the first CPU is measured)
+//          --warmup=N --reps=N | --min-reps=N --max-reps=N --max-time=S --ci=PCT, --outliers=K
+//          --json=FILE --csv=FILE --compare=BASELINE.json --threshold=PCT, --timer=tsc|steady
+int main(int argc, char** argv) {
+    report.init("instr_bench", argc, argv);
+    AffinityConfig affinity;
+    thread_cpus = affinity_from_args(argc, argv, affinity);
+    thread_cpus.resize(1);
+    MeasureConfig config;
+    config.max_seconds = 0.5;
+    measure_config_from_args(argc, argv, config);
+    timer_from_args(argc, argv);
+    report.set_placement(affinity, thread_cpus);
+    report.set_sampling(config);
+    std::string filter = argc > 1 ? argv[1] : "";
+
+    std::cout << "CPU: " << cpu_info().brand << "\n";
+    std::cout << describe_measure_config(config) << "\n";
+    std::cout << describe_timer() << "\n";
+    std::cout << describe_affinity(affinity, thread_cpus) << "\n";
+    WorkerPool pool(thread_cpus);
+    perf.open(pool);
+    std::cout << perf.describe() << "\n";
+
+    for (int i = 0; i < 4096; i++) {
+        GATHER_TABLE32[i] = i;
+        GATHER_TABLE64[i] = i;
+    }
+    // Flush denormals to zero on the worker, so no conversion or division
+    // chain can drift into microcode assists.
+    double ghz = 0.0;
+    pool.run(1, [&](int) {
+        _mm_setcsr(_mm_getcsr() | 0x8040);
+        ghz = estimate_core_ghz();
+    });
+    report.add_value("clock", {}, "core_clock", "GHz", ghz, true);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Core clock ~" << ghz << " GHz on worker 0\n"
+              << "Latency: core cycles per instruction along one dependent chain\n"
+              << "Throughput: reciprocal, core cycles per instruction over independent chains\n"
+              << "Cycles are " << (perf.available() ? "counted" : "derived from the estimated clock")
+              << "; CI95 is the wider of the two 95% confidence intervals\n";
+    std::cout << "------------------------\n";
+    std::cout << std::left << std::setw(36) << "Instruction" << std::right << std::setw(9) << "ISA"
+              << std::setw(8) << "Type" << std::setw(7) << "Width" << std::setw(9) << "Latency"
+              << std::setw(12) << "Throughput" << std::setw(8) << "Chains" << std::setw(8) << "CI95" << "\n";
+
+    for (const InstrKernel& k : INSTR_KERNELS) {
+        if (!filter.empty() && !matches(k, filter))
+            continue;
+        std::cout << std::left << std::setw(36) << k.instr << std::right << std::setw(9) << k.isa
+                  << std::setw(8) << k.type << std::setw(7) << k.width;
+        if (!cpu_info().supports(k.required)) {
+            std::cout << "  not supported on this host\n";
+            continue;
+        }
+        InstrResult latency = measure_instr(pool, k.latency, 1, ghz, config);
+        InstrResult throughput = measure_instr(pool, k.throughput, k.chains, ghz, config);
+        double ci = 100.0 * std::max(latency.stats.ci, throughput.stats.ci);
+        std::cout << std::setw(9) << latency.cycles << std::setw(12) << throughput.cycles
+                  << std::setw(8) << k.chains << std::setw(7) << ci << "%\n";
+
+        ResultParams params = {{"instr", k.instr}, {"isa", k.isa}, {"type", k.type},
+                               {"width", std::to_string(k.width)}};
+        report.add_time("instr", params, "latency", "cycles", latency.stats,
+                        latency.clock_hz / ITERATIONS);
+        report.add_time("instr", params, "recip_throughput", "cycles", throughput.stats,
+                        throughput.clock_hz / (double(ITERATIONS) * k.chains));
+    }
+
+    return report.finish(0);
+}
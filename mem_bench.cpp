@@ -1,14 +1,33 @@
-#pragma GCC optimize ("O0")
-
 #include <iostream>
 #include <chrono>
 #include <thread>
 #include <vector>
 #include <cstring> // for memset
 
+#include "affinity.h"
+#include "bench_report.h"
+#include "bench_stats.h"
+#include "cpu_clock.h"
+#include "cpu_topology.h"
+#include "worker_pool.h"
+
+// Only this file's kernels are unoptimized; the headers above, whose pool
+// barrier and region timer run inside the timed region, are built normally.
+#pragma GCC optimize ("O0")
+
 using namespace std;
 using namespace chrono;
 
+vector<int> thread_cpus; // CPU for worker i, from --affinity
+MeasureConfig measure_config; // warmup and repetitions, from --warmup/--reps/...
+BenchReport report; // --json/--csv/--compare
+
+// Bytes of `size` covered by `threads` equal chunks of whole cache lines, so
+// no chunk loop steps past its end (or the last one past the mapping).
+size_t whole_chunks(size_t size, int threads) {
+    return size / threads / 64 * 64 * threads;
+}
+
 // Function to measure write bandwidth in a specific memory chunk
 void write_memory_chunk(char* memory, size_t chunk_size) {
     long long value = 0x0101010101010101LL; // A 64-bit pattern to write
@@ -17,28 +36,15 @@ void write_memory_chunk(char* memory, size_t chunk_size) {
     }
 }
 
-// Function to measure write bandwidth with multiple threads
-double measure_write_bandwidth(char* memory, size_t size, int thread_count) {
-    vector<thread> threads;
-    size_t chunk_size = size / thread_count;
-
-    auto start = high_resolution_clock::now();
-
-    for (int i = 0; i < thread_count; ++i) {
-        threads.push_back(thread(write_memory_chunk, memory + i * chunk_size, chunk_size));
-    }
-
-    for (auto& t : threads) {
-        t.join();
-    }
-
-    auto end = high_resolution_clock::now();
-    auto duration = duration_cast<nanoseconds>(end - start).count();
-
-    double seconds = duration * 1e-9;
-    double bandwidth = (size / (1024.0 * 1024.0 * 1024.0)) / seconds; // GB/s
+// Function to measure write bandwidth with multiple threads; sample times in seconds
+SampleStats measure_write_bandwidth(WorkerPool& pool, char* memory, size_t size, int thread_count) {
+    size_t chunk_size = whole_chunks(size, thread_count) / thread_count;
 
-    return bandwidth;
+    return measure(measure_config, [&] {
+        return pool.run(thread_count, [=](int i) {
+            write_memory_chunk(memory + i * chunk_size, chunk_size);
+        });
+    });
 }
 
 // Function to measure read bandwidth in a specific memory chunk
@@ -50,68 +56,78 @@ void read_memory_chunk(volatile char* memory, size_t chunk_size, volatile char*
     *sum += static_cast<char>(local_sum);
 }
 
-// Function to measure read bandwidth with multiple threads
-double measure_read_bandwidth(char* memory, size_t size, int thread_count) {
-    vector<thread> threads;
-    size_t chunk_size = size / thread_count;
-    volatile char sum = 0;
-
-    auto start = high_resolution_clock::now();
-
-    for (int i = 0; i < thread_count; ++i) {
-        threads.push_back(thread(read_memory_chunk, memory + i * chunk_size, chunk_size, &sum));
-    }
-
-    for (auto& t : threads) {
-        t.join();
-    }
+// Function to measure read bandwidth with multiple threads; sample times in seconds
+SampleStats measure_read_bandwidth(WorkerPool& pool, char* memory, size_t size, int thread_count) {
+    size_t chunk_size = whole_chunks(size, thread_count) / thread_count;
+    std::vector<WorkerSlot<volatile char>> sums(thread_count); // one line per thread, no shared writes
 
-    auto end = high_resolution_clock::now();
-    auto duration = duration_cast<nanoseconds>(end - start).count();
-
-    double seconds = duration * 1e-9;
-    double bandwidth = (size / (1024.0 * 1024.0 * 1024.0)) / seconds; // GB/s
-
-    return bandwidth;
+    return measure(measure_config, [&] {
+        return pool.run(thread_count, [=, &sums](int i) {
+            read_memory_chunk(memory + i * chunk_size, chunk_size, &sums[i].value);
+        });
+    });
 }
 
-int main() {
-    size_t size = 1 * 1024 * 1024 * 1024; // 1 GiB
-    char* memory = new char[size];
-
-    const int iterations = 10; //run 10x
-
-    cout << iterations << " X " << size/(1024*1024*1024) << " GB" << "\n";
+// Usage: mem_bench [--affinity=scatter|compact|physical|none|<cpu list>] [--pages=default|nothp|thp|2m|1g]
+//                  [--warmup=N] [--reps=N | --min-reps=N --max-reps=N --max-time=S --ci=PCT] [--outliers=K]
+//                  [--json=FILE] [--csv=FILE] [--compare=BASELINE.json] [--threshold=PCT] [--timer=tsc|steady]
+int main(int argc, char** argv) {
+    report.init("mem_bench", argc, argv);
+    AffinityConfig affinity;
+    thread_cpus = affinity_from_args(argc, argv, affinity);
+    pages_from_args(argc, argv);
+    measure_config_from_args(argc, argv, measure_config);
+    timer_from_args(argc, argv);
+    report.set_placement(affinity, thread_cpus);
+    report.set_sampling(measure_config);
+    WorkerPool pool(thread_cpus);
+
+    size_t size = cpu_topology().memory_working_set(); // 4x all caches, at least 256 MiB
+
+    cout << format_size(size) << " per run" << "\n";
+    cout << describe_measure_config(measure_config) << "\n";
+    cout << describe_timer() << "\n";
+    cout << describe_affinity(affinity, thread_cpus) << "\n";
+    cout << describe_pages(page_backend()) << "\n";
     cout << "-----------------------\n";
 
     // Measure read and write bandwidth with multiple threads
-    for (int thread_count = 1; thread_count <= thread::hardware_concurrency(); thread_count++) {
-        double total_write_bandwidth = 0.0;
-        double total_read_bandwidth = 0.0;
+    for (int thread_count = 1; thread_count <= (int)thread_cpus.size(); thread_count++) {
+        // Fresh buffer per thread count so every chunk is first touched by its own pinned thread
+        char* memory = first_touch_alloc(size, thread_count, thread_cpus);
+        if (!memory) {
+            cerr << "Cannot allocate " << format_size(size) << "\n";
+            return report.finish(1);
+        }
+        double gib = whole_chunks(size, thread_count) / (1024.0 * 1024.0 * 1024.0);
+        SampleStats write_stats = measure_write_bandwidth(pool, memory, size, thread_count);
+        SampleStats read_stats = measure_read_bandwidth(pool, memory, size, thread_count);
 
-        // Run the test 10 times for each thread count
-        for (int i = 0; i < iterations; i++) {
-            double write_bandwidth = measure_write_bandwidth(memory, size, thread_count);
-            double read_bandwidth = measure_read_bandwidth(memory, size, thread_count);
+        ResultParams params = {{"threads", to_string(thread_count)}};
+        report.add_rate("bandwidth", params, "read_bandwidth", "GB/s", read_stats, gib);
+        report.add_rate("bandwidth", params, "write_bandwidth", "GB/s", write_stats, gib);
 
-            total_write_bandwidth += write_bandwidth;
-            total_read_bandwidth += read_bandwidth;
-        }
+        // Per thread, one 64-byte cache line as the operation
+        double lines = whole_chunks(size, thread_count) / 64.0 / thread_count;
+        CycleStats read_cycles = cycle_stats(read_stats, PerfSample(), lines, thread_count);
+        CycleStats write_cycles = cycle_stats(write_stats, PerfSample(), lines, thread_count);
+        report.add_cycles("bandwidth", with_param(params, "access", "read"), read_cycles, "line");
+        report.add_cycles("bandwidth", with_param(params, "access", "write"), write_cycles, "line");
 
-        // Calculate averages and ratios
-        double avg_write_bandwidth = total_write_bandwidth / iterations;
-        double avg_read_bandwidth = total_read_bandwidth / iterations;
-        double ratio = avg_read_bandwidth/avg_write_bandwidth;
+        // Ratio of the medians
+        double ratio = write_stats.median / read_stats.median;
 
         // Print the results
         cout << "Threads: " << thread_count << endl;
-        cout << "Read Bandwidth: " << avg_read_bandwidth << " GB/s" << endl;
-        cout << "Write Bandwidth: " << avg_write_bandwidth << " GB/s" << endl;
+        cout << "Read Bandwidth: " << format_rate_stats(read_stats, gib) << " GB/s" << endl;
+        cout << "Write Bandwidth: " << format_rate_stats(write_stats, gib) << " GB/s" << endl;
+        cout << "Read cycles: " << format_cycles(read_cycles, "line") << endl;
+        cout << "Write cycles: " << format_cycles(write_cycles, "line") << endl;
         cout << "Read to Write: " << ratio << " x" << endl;
         cout << "-----------------------\n";
 
+        first_touch_free(memory, size);
     }
 
-    delete[] memory;
-    return 0;
+    return report.finish(0);
 }
@@ -3,25 +3,93 @@
 #include <thread>
 #include <vector>
 #include <cstring>
+#include <cstdint>
+#include <iomanip>
+#include <random>
+#include <string>
 #include <immintrin.h>
 
+#include "affinity.h"
+#include "bench_report.h"
+#include "bench_stats.h"
+#include "cpu_clock.h"
+#include "cpu_info.h"
+#include "cpu_topology.h"
+#include "perf_counters.h"
+#include "worker_pool.h"
+
 using namespace std;
 using namespace chrono;
 
+vector<int> thread_cpus; // CPU for worker i, from --affinity
+MeasureConfig measure_config; // warmup and repetitions, from --warmup/--reps/...
+BenchReport report; // --json/--csv/--compare
+PoolCounters perf;  // per-worker hardware counters of the main pool, when permitted
+
+//------------------------//
+// Access patterns
+//------------------------//
+
+// How a read or write kernel walks its chunk: one access of the kernel's
+// width every `stride` bytes (0: back to back), last to first when
+// `reverse`, the chunk split into `streams` equal regions walked in
+// lockstep, and a software prefetch `prefetch` bytes ahead in each stream
+// (0: none). The default is the plain forward sweep, which the kernels run
+// as their original tight loop.
+struct AccessPattern {
+    size_t stride = 0;
+    bool reverse = false;
+    int streams = 1;
+    size_t prefetch = 0;
+
+    bool sequential() const { return stride == 0 && !reverse && streams == 1 && prefetch == 0; }
+
+    size_t step(size_t width) const { return std::max(stride, width); }
+    size_t region(size_t chunk_size, size_t width) const { return chunk_size / streams / step(width) * step(width); }
+    size_t accesses(size_t chunk_size, size_t width) const { return region(chunk_size, width) / step(width) * streams; }
+};
+
+// Runs the statement after the pattern arguments with `p` at each access.
+// Prefetches past either end of the chunk are harmless: they never fault.
+#define FOR_EACH_ACCESS(memory, chunk_size, pattern, width, ...)                                         \
+    do {                                                                                                 \
+        size_t step_ = (pattern).step(width);                                                            \
+        size_t region_ = (pattern).region(chunk_size, width);                                            \
+        ptrdiff_t ahead_ = (pattern).reverse ? -ptrdiff_t((pattern).prefetch) : ptrdiff_t((pattern).prefetch); \
+        for (size_t k_ = 0; k_ < region_; k_ += step_) {                                                 \
+            size_t offset_ = (pattern).reverse ? region_ - step_ - k_ : k_;                              \
+            for (int s_ = 0; s_ < (pattern).streams; s_++) {                                             \
+                auto p = (memory) + s_ * region_ + offset_;                                              \
+                if ((pattern).prefetch)                                                                  \
+                    _mm_prefetch((const char*)(p) + ahead_, _MM_HINT_T0);                                \
+                __VA_ARGS__;                                                                             \
+            }                                                                                            \
+        }                                                                                                \
+    } while (0)
+
 //------------------------//
 // Scalar versions
 //------------------------//
 
-void write_memory_chunk_scalar(char* memory, size_t chunk_size) {
+void write_memory_chunk_scalar(char* memory, size_t chunk_size, const AccessPattern& pattern) {
     long long value = 0x0101010101010101LL;
-    for (size_t i = 0; i < chunk_size; i += sizeof(long long))
-        *(reinterpret_cast<long long*>(memory + i)) = value;
+    if (pattern.sequential()) {
+        for (size_t i = 0; i < chunk_size; i += sizeof(long long))
+            *(reinterpret_cast<long long*>(memory + i)) = value;
+        return;
+    }
+    FOR_EACH_ACCESS(memory, chunk_size, pattern, sizeof(long long), *(reinterpret_cast<long long*>(p)) = value);
 }
 
-void read_memory_chunk_scalar(volatile char* memory, size_t chunk_size, volatile char* sum) {
+void read_memory_chunk_scalar(volatile char* memory, size_t chunk_size, volatile char* sum, const AccessPattern& pattern) {
     volatile long long local_sum = 0;
-    for (size_t i = 0; i < chunk_size; i += sizeof(long long))
-        local_sum += *(reinterpret_cast<volatile long long*>(memory + i));
+    if (pattern.sequential()) {
+        for (size_t i = 0; i < chunk_size; i += sizeof(long long))
+            local_sum += *(reinterpret_cast<volatile long long*>(memory + i));
+    } else {
+        FOR_EACH_ACCESS(memory, chunk_size, pattern, sizeof(long long),
+                        local_sum += *(reinterpret_cast<volatile long long*>(p)));
+    }
     *sum += static_cast<char>(local_sum);
 }
 
@@ -29,18 +97,28 @@ void read_memory_chunk_scalar(volatile char* memory, size_t chunk_size, volatile
 // SSE versions (128-bit)
 //------------------------//
 
-void write_memory_chunk_sse(char* memory, size_t chunk_size) {
+void write_memory_chunk_sse(char* memory, size_t chunk_size, const AccessPattern& pattern) {
     __m128i value = _mm_set1_epi64x(0x0101010101010101LL);
-    for (size_t i = 0; i < chunk_size; i += sizeof(__m128i))
-        _mm_storeu_si128(reinterpret_cast<__m128i*>(memory + i), value);
+    if (pattern.sequential()) {
+        for (size_t i = 0; i < chunk_size; i += sizeof(__m128i))
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(memory + i), value);
+        return;
+    }
+    FOR_EACH_ACCESS(memory, chunk_size, pattern, sizeof(__m128i),
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), value));
 }
 
-void read_memory_chunk_sse(volatile char* memory, size_t chunk_size, volatile char* sum) {
+void read_memory_chunk_sse(volatile char* memory, size_t chunk_size, volatile char* sum, const AccessPattern& pattern) {
     const char* mem_ptr = const_cast<const char*>(memory);
     __m128i local_sum = _mm_setzero_si128();
-    for (size_t i = 0; i < chunk_size; i += sizeof(__m128i)) {
-        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mem_ptr + i));
-        local_sum = _mm_add_epi8(local_sum, data);
+    if (pattern.sequential()) {
+        for (size_t i = 0; i < chunk_size; i += sizeof(__m128i)) {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mem_ptr + i));
+            local_sum = _mm_add_epi8(local_sum, data);
+        }
+    } else {
+        FOR_EACH_ACCESS(mem_ptr, chunk_size, pattern, sizeof(__m128i),
+                        local_sum = _mm_add_epi8(local_sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
     }
     alignas(16) char tmp[16];
     _mm_store_si128(reinterpret_cast<__m128i*>(tmp), local_sum);
@@ -52,29 +130,42 @@ void read_memory_chunk_sse(volatile char* memory, size_t chunk_size, volatile ch
 // AVX versions (256-bit)
 //------------------------//
 
-void write_memory_chunk_avx(char* memory, size_t chunk_size) {
+ISA_AVX void write_memory_chunk_avx(char* memory, size_t chunk_size, const AccessPattern& pattern) {
     __m256i value = _mm256_set1_epi64x(0x0101010101010101LL);
-    for (size_t i = 0; i < chunk_size; i += sizeof(__m256i))
-        _mm256_storeu_si256(reinterpret_cast<__m256i*>(memory + i), value);
+    if (pattern.sequential()) {
+        for (size_t i = 0; i < chunk_size; i += sizeof(__m256i))
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(memory + i), value);
+        return;
+    }
+    FOR_EACH_ACCESS(memory, chunk_size, pattern, sizeof(__m256i),
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), value));
 }
 
-// AVX read: we avoid the AVX2-only _mm256_extracti128_si256 by extracting via floating‑point conversion.
-void read_memory_chunk_avx(volatile char* memory, size_t chunk_size, volatile char* sum) {
+// Adds the 32 bytes at p to the 128-bit sum. We avoid the AVX2-only
+// _mm256_extracti128_si256 by extracting via floating-point conversion.
+ISA_AVX inline __m128i add_halves_avx(__m128i local_sum, const char* p) {
+    // Load 256 bits
+    __m256i data256 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    // Lower 128 bits:
+    __m128i lower = _mm256_castsi256_si128(data256);
+    // Extract upper 128 bits via float conversion (available in AVX):
+    __m256  data_ps = _mm256_castsi256_ps(data256);
+    __m128   upper_ps = _mm256_extractf128_ps(data_ps, 1);
+    __m128i upper = _mm_castps_si128(upper_ps);
+    // Add the two 128-bit halves
+    __m128i sum128 = _mm_add_epi8(lower, upper);
+    return _mm_add_epi8(local_sum, sum128);
+}
+
+ISA_AVX void read_memory_chunk_avx(volatile char* memory, size_t chunk_size, volatile char* sum, const AccessPattern& pattern) {
     const char* mem_ptr = const_cast<const char*>(memory);
     __m128i local_sum = _mm_setzero_si128();
-    // Process 32 bytes per iteration.
-    for (size_t i = 0; i < chunk_size; i += 32) {
-        // Load 256 bits
-        __m256i data256 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mem_ptr + i));
-        // Lower 128 bits:
-        __m128i lower = _mm256_castsi256_si128(data256);
-        // Extract upper 128 bits via float conversion (available in AVX):
-        __m256  data_ps = _mm256_castsi256_ps(data256);
-        __m128   upper_ps = _mm256_extractf128_ps(data_ps, 1);
-        __m128i upper = _mm_castps_si128(upper_ps);
-        // Add the two 128-bit halves
-        __m128i sum128 = _mm_add_epi8(lower, upper);
-        local_sum = _mm_add_epi8(local_sum, sum128);
+    if (pattern.sequential()) {
+        // Process 32 bytes per iteration.
+        for (size_t i = 0; i < chunk_size; i += 32)
+            local_sum = add_halves_avx(local_sum, mem_ptr + i);
+    } else {
+        FOR_EACH_ACCESS(mem_ptr, chunk_size, pattern, 32, local_sum = add_halves_avx(local_sum, p));
     }
     alignas(16) char tmp[16]; // Use 16-byte alignment for 128-bit store.
     _mm_store_si128(reinterpret_cast<__m128i*>(tmp), local_sum);
@@ -82,80 +173,1304 @@ void read_memory_chunk_avx(volatile char* memory, size_t chunk_size, volatile ch
         *sum += tmp[i];
 }
 
+//------------------------//
+// AVX-512 versions (512-bit)
+//------------------------//
+
+ISA_AVX512 void write_memory_chunk_avx512(char* memory, size_t chunk_size, const AccessPattern& pattern) {
+    __m512i value = _mm512_set1_epi64(0x0101010101010101LL);
+    if (pattern.sequential()) {
+        for (size_t i = 0; i < chunk_size; i += sizeof(__m512i))
+            _mm512_storeu_si512(reinterpret_cast<__m512i*>(memory + i), value);
+        return;
+    }
+    FOR_EACH_ACCESS(memory, chunk_size, pattern, sizeof(__m512i), _mm512_storeu_si512(p, value));
+}
+
+ISA_AVX512 void read_memory_chunk_avx512(volatile char* memory, size_t chunk_size, volatile char* sum, const AccessPattern& pattern) {
+    const char* mem_ptr = const_cast<const char*>(memory);
+    __m512i local_sum = _mm512_setzero_si512();
+    if (pattern.sequential()) {
+        for (size_t i = 0; i < chunk_size; i += sizeof(__m512i))
+            local_sum = _mm512_add_epi8(local_sum, _mm512_loadu_si512(mem_ptr + i));
+    } else {
+        FOR_EACH_ACCESS(mem_ptr, chunk_size, pattern, sizeof(__m512i),
+                        local_sum = _mm512_add_epi8(local_sum, _mm512_loadu_si512(p)));
+    }
+    alignas(64) char tmp[64];
+    _mm512_store_si512(tmp, local_sum);
+    for (int i = 0; i < 64; i++)
+        *sum += tmp[i];
+}
+
+//------------------------//
+// Kernel dispatch
+//------------------------//
+
+typedef void (*WriteKernel)(char* memory, size_t chunk_size, const AccessPattern& pattern);
+typedef void (*ReadKernel)(volatile char* memory, size_t chunk_size, volatile char* sum, const AccessPattern& pattern);
+
+struct MemKernel {
+    const char* name;
+    FeatureMask required;
+    size_t width; // bytes per access
+    WriteKernel write;
+    ReadKernel read;
+};
+
+// Narrowest first; only the ones the host supports are run.
+const MemKernel MEM_KERNELS[] = {
+    { "Scalar",  0,            8,  write_memory_chunk_scalar, read_memory_chunk_scalar },
+    { "SSE",     0,            16, write_memory_chunk_sse,    read_memory_chunk_sse },
+    { "AVX",     NEEDS_AVX,    32, write_memory_chunk_avx,    read_memory_chunk_avx },
+    { "AVX-512", NEEDS_AVX512, 64, write_memory_chunk_avx512, read_memory_chunk_avx512 },
+};
+
+//------------------------//
+// STREAM kernels (double)
+//------------------------//
+
+// Same operations and byte accounting as McCalpin's STREAM: Copy and Scale
+// move 16 bytes per element, Add and Triad 24. Write-allocate traffic is
+// not counted, so regular-store results compare directly with published
+// STREAM numbers and the non-temporal variants show what avoiding it buys.
+enum StreamOp { STREAM_COPY, STREAM_SCALE, STREAM_ADD, STREAM_TRIAD };
+
+const char* const STREAM_NAMES[] = { "Copy", "Scale", "Add", "Triad" };
+const double STREAM_BYTES_PER_ELEMENT[] = { 16, 16, 24, 24 };
+
+typedef void (*StreamKernel)(double* a, double* b, double* c, double q, size_t n, size_t prefetch);
+
+// Prefetches the input streams of `op` at element i. Kernels walk one cache
+// line (8 doubles) per step, so this issues one prefetch per line per stream.
+template<StreamOp op>
+inline void prefetch_stream_inputs(const double* a, const double* b, const double* c, size_t i) {
+    if (op == STREAM_COPY || op == STREAM_ADD)
+        _mm_prefetch(reinterpret_cast<const char*>(a + i), _MM_HINT_T0);
+    if (op == STREAM_ADD || op == STREAM_TRIAD)
+        _mm_prefetch(reinterpret_cast<const char*>(b + i), _MM_HINT_T0);
+    if (op == STREAM_SCALE || op == STREAM_TRIAD)
+        _mm_prefetch(reinterpret_cast<const char*>(c + i), _MM_HINT_T0);
+}
+
+template<bool NT>
+inline void store_scalar(double* p, double v) {
+    if (NT) {
+        long long bits;
+        memcpy(&bits, &v, sizeof(bits));
+        _mm_stream_si64(reinterpret_cast<long long*>(p), bits);
+    } else {
+        *p = v;
+    }
+}
+
+// Kept scalar on purpose: GCC vectorizes plain loops at -O2.
+template<StreamOp op, bool NT>
+__attribute__((optimize("no-tree-vectorize")))
+void stream_kernel_scalar(double* a, double* b, double* c, double q, size_t n, size_t prefetch) {
+    for (size_t i = 0; i < n; i += 8) {
+        if (prefetch)
+            prefetch_stream_inputs<op>(a, b, c, i + prefetch);
+        for (size_t j = i; j < i + 8; j++) {
+            switch (op) {
+            case STREAM_COPY:  store_scalar<NT>(c + j, a[j]); break;
+            case STREAM_SCALE: store_scalar<NT>(b + j, q * c[j]); break;
+            case STREAM_ADD:   store_scalar<NT>(c + j, a[j] + b[j]); break;
+            case STREAM_TRIAD: store_scalar<NT>(a + j, b[j] + q * c[j]); break;
+            }
+        }
+    }
+    if (NT)
+        _mm_sfence();
+}
+
+template<bool NT>
+inline void store_sse(double* p, __m128d v) {
+    if (NT) _mm_stream_pd(p, v);
+    else    _mm_store_pd(p, v);
+}
+
+template<StreamOp op, bool NT>
+void stream_kernel_sse(double* a, double* b, double* c, double q, size_t n, size_t prefetch) {
+    __m128d vq = _mm_set1_pd(q);
+    for (size_t i = 0; i < n; i += 8) {
+        if (prefetch)
+            prefetch_stream_inputs<op>(a, b, c, i + prefetch);
+        for (size_t j = i; j < i + 8; j += 2) {
+            switch (op) {
+            case STREAM_COPY:  store_sse<NT>(c + j, _mm_load_pd(a + j)); break;
+            case STREAM_SCALE: store_sse<NT>(b + j, _mm_mul_pd(vq, _mm_load_pd(c + j))); break;
+            case STREAM_ADD:   store_sse<NT>(c + j, _mm_add_pd(_mm_load_pd(a + j), _mm_load_pd(b + j))); break;
+            case STREAM_TRIAD: store_sse<NT>(a + j, _mm_add_pd(_mm_load_pd(b + j), _mm_mul_pd(vq, _mm_load_pd(c + j)))); break;
+            }
+        }
+    }
+    if (NT)
+        _mm_sfence();
+}
+
+template<bool NT>
+ISA_AVX inline void store_avx(double* p, __m256d v) {
+    if (NT) _mm256_stream_pd(p, v);
+    else    _mm256_store_pd(p, v);
+}
+
+template<StreamOp op, bool NT>
+ISA_AVX void stream_kernel_avx(double* a, double* b, double* c, double q, size_t n, size_t prefetch) {
+    __m256d vq = _mm256_set1_pd(q);
+    for (size_t i = 0; i < n; i += 8) {
+        if (prefetch)
+            prefetch_stream_inputs<op>(a, b, c, i + prefetch);
+        for (size_t j = i; j < i + 8; j += 4) {
+            switch (op) {
+            case STREAM_COPY:  store_avx<NT>(c + j, _mm256_load_pd(a + j)); break;
+            case STREAM_SCALE: store_avx<NT>(b + j, _mm256_mul_pd(vq, _mm256_load_pd(c + j))); break;
+            case STREAM_ADD:   store_avx<NT>(c + j, _mm256_add_pd(_mm256_load_pd(a + j), _mm256_load_pd(b + j))); break;
+            case STREAM_TRIAD: store_avx<NT>(a + j, _mm256_add_pd(_mm256_load_pd(b + j), _mm256_mul_pd(vq, _mm256_load_pd(c + j)))); break;
+            }
+        }
+    }
+    if (NT)
+        _mm_sfence();
+}
+
+template<bool NT>
+ISA_AVX512 inline void store_avx512(double* p, __m512d v) {
+    if (NT) _mm512_stream_pd(p, v);
+    else    _mm512_store_pd(p, v);
+}
+
+template<StreamOp op, bool NT>
+ISA_AVX512 void stream_kernel_avx512(double* a, double* b, double* c, double q, size_t n, size_t prefetch) {
+    __m512d vq = _mm512_set1_pd(q);
+    for (size_t i = 0; i < n; i += 8) {
+        if (prefetch)
+            prefetch_stream_inputs<op>(a, b, c, i + prefetch);
+        switch (op) {
+        case STREAM_COPY:  store_avx512<NT>(c + i, _mm512_load_pd(a + i)); break;
+        case STREAM_SCALE: store_avx512<NT>(b + i, _mm512_mul_pd(vq, _mm512_load_pd(c + i))); break;
+        case STREAM_ADD:   store_avx512<NT>(c + i, _mm512_add_pd(_mm512_load_pd(a + i), _mm512_load_pd(b + i))); break;
+        case STREAM_TRIAD: store_avx512<NT>(a + i, _mm512_add_pd(_mm512_load_pd(b + i), _mm512_mul_pd(vq, _mm512_load_pd(c + i)))); break;
+        }
+    }
+    if (NT)
+        _mm_sfence();
+}
+
 //------------------------//
 // Benchmark wrappers
 //------------------------//
 
+// Bytes of `size` that `threads` equal chunks cover when each chunk is a
+// whole number of 64-byte steps. The kernels have no scalar tail, so a
+// ragged chunk would run up to a vector past its end, past the mapping for
+// the last thread.
+inline size_t whole_chunks(size_t size, int threads) {
+    return size / threads / 64 * 64 * threads;
+}
+
+// Each thread runs the kernel `reps` times over its own chunk, so small
+// (cache-resident) chunks still give a measurable interval; `pattern` sets
+// the walk (default: forward, back to back). Chunks cover
+// whole_chunks(size, thread_count) bytes, so samples are seconds per run
+// and GB per run is gigabytes(whole_chunks(size, thread_count) * reps).
+// Hardware counters for the measurement are in perf.total(thread_count)
+// afterwards.
 template<typename WriteFunc>
-double measure_write_bandwidth(char* memory, size_t size, int thread_count, WriteFunc write_func) {
-    vector<thread> threads;
-    size_t chunk_size = size / thread_count;
-    auto start = high_resolution_clock::now();
-    for (int i = 0; i < thread_count; i++)
-        threads.push_back(thread(write_func, memory + i * chunk_size, chunk_size));
-    for (auto& t : threads)
-        t.join();
-    auto end = high_resolution_clock::now();
-    double seconds = duration_cast<nanoseconds>(end - start).count() * 1e-9;
-    return (size / (1024.0 * 1024.0 * 1024.0)) / seconds;
+SampleStats measure_write_bandwidth(WorkerPool& pool, char* memory, size_t size, int thread_count, WriteFunc write_func, size_t reps = 1,
+                                    const AccessPattern& pattern = AccessPattern()) {
+    size_t chunk_size = whole_chunks(size, thread_count) / thread_count;
+    perf.reset();
+    return measure(measure_config, [&] {
+        return pool.run(thread_count, [=](int i) {
+            perf.start(i);
+            for (size_t r = 0; r < reps; r++)
+                write_func(memory + i * chunk_size, chunk_size, pattern);
+            perf.stop(i);
+        });
+    });
 }
 
 template<typename ReadFunc>
-double measure_read_bandwidth(char* memory, size_t size, int thread_count, ReadFunc read_func) {
-    vector<thread> threads;
-    size_t chunk_size = size / thread_count;
-    volatile char sum = 0;
-    auto start = high_resolution_clock::now();
-    for (int i = 0; i < thread_count; i++)
-        threads.push_back(thread(read_func, memory + i * chunk_size, chunk_size, &sum));
-    for (auto& t : threads)
-        t.join();
-    auto end = high_resolution_clock::now();
-    double seconds = duration_cast<nanoseconds>(end - start).count() * 1e-9;
-    return (size / (1024.0 * 1024.0 * 1024.0)) / seconds;
-}
-
-int main() {
-    size_t size = 1ULL * 1024 * 1024 * 1024; // 1 GiB
-    char* memory = new char[size];
-
-    const int iterations = 5;
-    int max_threads = thread::hardware_concurrency();
-
-    cout << "1 GB test on " << max_threads << " threads\n";
+SampleStats measure_read_bandwidth(WorkerPool& pool, char* memory, size_t size, int thread_count, ReadFunc read_func, size_t reps = 1,
+                                   const AccessPattern& pattern = AccessPattern()) {
+    size_t chunk_size = whole_chunks(size, thread_count) / thread_count;
+    std::vector<WorkerSlot<volatile char>> sums(thread_count); // one line per thread, no shared writes
+    perf.reset();
+    return measure(measure_config, [&] {
+        return pool.run(thread_count, [=, &sums](int i) {
+            perf.start(i);
+            for (size_t r = 0; r < reps; r++)
+                read_func(memory + i * chunk_size, chunk_size, &sums[i].value, pattern);
+            perf.stop(i);
+        });
+    });
+}
+
+inline double gigabytes(size_t bytes) {
+    return bytes / (1024.0 * 1024.0 * 1024.0);
+}
+
+// Adds the counters and cycles per 64-byte line of one measurement to the
+// report; `bytes_per_thread` is what each thread moves per run.
+CycleStats report_line_cycles(const string& benchmark, const ResultParams& params, const SampleStats& stats,
+                              const PerfSample& counters, double bytes_per_thread, int threads) {
+    CycleStats cycles = cycle_stats(stats, counters, bytes_per_thread / 64.0, threads);
+    report.add_perf(benchmark, params, counters);
+    report.add_cycles(benchmark, params, cycles, "line");
+    return cycles;
+}
+
+//------------------------//
+// Latency (pointer chase)
+//------------------------//
+
+const size_t CACHE_LINE = cpu_topology().line_size();
+const size_t PAGE_SIZE = 4096;
+
+// Address of slot `index` in a chain with the given stride. Page-granular
+// chains put each slot on a pseudo-random line of its page so the chase
+// doesn't keep hitting the same cache set.
+inline char* chain_slot(char* memory, size_t index, size_t stride) {
+    size_t offset = 0;
+    if (stride > CACHE_LINE)
+        offset = ((index * 0x9E3779B97F4A7C15ULL) >> 40) % (stride / CACHE_LINE) * CACHE_LINE;
+    return memory + index * stride + offset;
+}
+
+// Links size/stride slots into one random cycle (Sattolo's algorithm), so
+// each load depends on the previous one and the prefetchers can't follow it.
+void build_pointer_chain(char* memory, size_t size, size_t stride, mt19937_64& rng) {
+    size_t slots = size / stride;
+    for (size_t i = 0; i < slots; i++)
+        *reinterpret_cast<char**>(chain_slot(memory, i, stride)) = chain_slot(memory, i, stride);
+    for (size_t i = slots - 1; i > 0; i--) {
+        size_t j = uniform_int_distribution<size_t>(0, i - 1)(rng);
+        swap(*reinterpret_cast<char**>(chain_slot(memory, i, stride)),
+             *reinterpret_cast<char**>(chain_slot(memory, j, stride)));
+    }
+}
+
+char* chase_pointers(char* start, size_t loads) {
+    char* p = start;
+    for (size_t i = 0; i < loads; i += 8) {
+        p = *reinterpret_cast<char**>(p); p = *reinterpret_cast<char**>(p);
+        p = *reinterpret_cast<char**>(p); p = *reinterpret_cast<char**>(p);
+        p = *reinterpret_cast<char**>(p); p = *reinterpret_cast<char**>(p);
+        p = *reinterpret_cast<char**>(p); p = *reinterpret_cast<char**>(p);
+    }
+    return p;
+}
+
+char* volatile chase_sink; // keeps the final pointer live
+
+// Load-to-use latency in ns per load over a random chain spanning `size`
+// bytes; the warmup runs of the harness warm caches and TLB.
+SampleStats measure_load_latency(char* memory, size_t size, size_t stride, mt19937_64& rng) {
+    size_t slots = size / stride;
+    size_t loads = min<size_t>(max<size_t>(slots * 2, 1 << 20), 1 << 22);
+
+    build_pointer_chain(memory, size, stride, rng);
+    char* p = memory;
+    SampleStats stats = measure(measure_config, [&] {
+        uint64_t start = timer_begin();
+        p = chase_pointers(p, loads);
+        return timer_seconds(timer_end() - start);
+    });
+    chase_sink = p;
+
+    return scale_stats(stats, 1e9 / loads);
+}
+
+int run_latency_sweep(size_t max_size) {
+    pin_current_thread(thread_cpus[0]);
+    char* memory = first_touch_alloc(max_size, 1, thread_cpus);
+    if (!memory) {
+        cerr << "Cannot allocate " << format_size(max_size) << "\n";
+        return 1;
+    }
+    mt19937_64 rng(42);
+    double ghz = estimate_core_ghz();
+
+    cout << "Pointer-chase latency, 4 KiB to " << format_size(max_size)
+         << ", core clock ~" << fixed << setprecision(2) << ghz << " GHz\n";
+    cout << "-----------------------\n";
+    cout << setw(10) << "Size" << setw(12) << "Line ns" << setw(12) << "Line cyc"
+         << setw(12) << "Page ns" << setw(12) << "Page cyc" << setw(7) << "Fits" << "\n";
+
+    for (size_t size = 4096; size <= max_size; size *= 2) {
+        SampleStats line = measure_load_latency(memory, size, CACHE_LINE, rng);
+        report.add_time("latency", {{"size", format_size(size)}, {"stride", "line"}}, "load_latency", "ns", line, 1.0);
+        report.add_value("latency", {{"size", format_size(size)}, {"stride", "line"}}, "load_latency_cycles", "cycles",
+                         line.median * ghz, false);
+        double line_ns = line.median;
+        cout << setw(10) << format_size(size) << setw(12) << line_ns << setw(12) << line_ns * ghz;
+        if (size / PAGE_SIZE >= 2) {
+            SampleStats page = measure_load_latency(memory, size, PAGE_SIZE, rng);
+            report.add_time("latency", {{"size", format_size(size)}, {"stride", "page"}}, "load_latency", "ns", page, 1.0);
+            report.add_value("latency", {{"size", format_size(size)}, {"stride", "page"}}, "load_latency_cycles", "cycles",
+                             page.median * ghz, false);
+            double page_ns = page.median;
+            cout << setw(12) << page_ns << setw(12) << page_ns * ghz;
+        } else {
+            cout << setw(12) << "-" << setw(12) << "-";
+        }
+        cout << setw(7) << cpu_topology().fitting_level(size, 1) << endl;
+    }
+
+    first_touch_free(memory, max_size);
+    return 0;
+}
+
+//------------------------//
+// Loaded latency
+//------------------------//
+
+enum LoadedTraffic { TRAFFIC_READ, TRAFFIC_WRITE, TRAFFIC_MIXED };
+const char* const LOADED_TRAFFIC_NAMES[] = { "read", "write", "mixed" };
+
+const size_t INJECT_BLOCK = 16 * 1024;  // bytes per kernel call of an injector
+const size_t LOADED_CHASE = 1 << 19;    // chased loads per sample
+
+struct LoadedPoint {
+    string load;           // "idle", "10%".."90%" of the unthrottled bandwidth, "max"
+    double target = 0;     // requested aggregate GB/s, 0 for unthrottled
+    SampleStats latency;   // ns per load
+    double delivered = 0;  // median GB/s the injectors moved meanwhile
+};
+
+// One sample: worker 0 chases `chase` (a built pointer chain) while
+// workers 1.. run the widest read/write kernel over their chunks of
+// `traffic`, 16 KiB per call, each paced to `rate` bytes/s (0: flat out)
+// by spinning on the timer after a block. The injectors stop when the
+// chase ends; `gb_per_s` is what they moved over the chase's time.
+double time_loaded_latency(WorkerPool& pool, int threads, char* chase, char* traffic,
+                           size_t chunk, LoadedTraffic kind, double rate, double& gb_per_s) {
+    const MemKernel& k = widest_entry(MEM_KERNELS);
+    atomic<bool> stop(false);
+    vector<WorkerSlot<uint64_t>> moved(threads);
+    vector<WorkerSlot<volatile char>> sums(threads);
+    double ticks_per_block = rate > 0 ? INJECT_BLOCK / rate / timer_seconds(1) : 0;
+    double seconds = 0;
+    char* p = chase;
+
+    pool.run(threads, [&](int i) {
+        if (i == 0) {
+            uint64_t start = timer_begin();
+            p = chase_pointers(p, LOADED_CHASE);
+            seconds = timer_seconds(timer_end() - start);
+            stop.store(true, memory_order_relaxed);
+            return;
+        }
+        char* base = traffic + (i - 1) * chunk;
+        uint64_t bytes = 0;
+        uint64_t start = timer_begin();
+        for (size_t block = 0; !stop.load(memory_order_relaxed); block++) {
+            char* memory = base + block * INJECT_BLOCK % chunk;
+            bool write = kind == TRAFFIC_WRITE || (kind == TRAFFIC_MIXED && block % 3 == 2);
+            if (write)
+                k.write(memory, INJECT_BLOCK, AccessPattern());
+            else
+                k.read(memory, INJECT_BLOCK, &sums[i].value, AccessPattern());
+            bytes += INJECT_BLOCK;
+            if (ticks_per_block > 0) {
+                uint64_t due = start + uint64_t((block + 1) * ticks_per_block);
+                while (timer_end() < due && !stop.load(memory_order_relaxed))
+                    _mm_pause();
+            }
+        }
+        moved[i].value = bytes;
+    });
+    chase_sink = p;
+
+    uint64_t bytes = 0;
+    for (int i = 1; i < threads; i++)
+        bytes += moved[i].value;
+    gb_per_s = gigabytes(bytes) / seconds;
+    return seconds;
+}
+
+// Intel MLC-style loaded latency: a random line chase on the first
+// --affinity CPU under read, write or 2:1 mixed traffic from all the others.
+// The first point is idle, the second unthrottled; the rest pace the
+// injectors to 10%..90% of the unthrottled bandwidth, giving the latency
+// vs delivered bandwidth curve from idle to saturation.
+int run_loaded_latency(WorkerPool& pool, size_t size, LoadedTraffic kind) {
+    int threads = thread_cpus.size();
+    if (threads < 2) {
+        cerr << "Loaded latency needs at least two CPUs: one chasing, the rest injecting\n";
+        return 1;
+    }
+    vector<int> injector_cpus(thread_cpus.begin() + 1, thread_cpus.end());
+    size_t chunk = size / (threads - 1) / INJECT_BLOCK * INJECT_BLOCK;
+    char* chase = first_touch_alloc(size, 1, thread_cpus);
+    char* traffic = first_touch_alloc(chunk * (threads - 1), threads - 1, injector_cpus);
+    if (!chase || !traffic || chunk == 0) {
+        cerr << "Cannot allocate " << format_size(size) << " twice\n";
+        return 1;
+    }
+    mt19937_64 rng(42);
+    build_pointer_chain(chase, size, CACHE_LINE, rng);
+
+    cout << "Loaded latency: random line chase over " << format_size(size) << " on CPU " << thread_cpus[0] << ", "
+         << LOADED_TRAFFIC_NAMES[kind] << " traffic from " << threads - 1 << (threads == 2 ? " thread (" : " threads (")
+         << widest_entry(MEM_KERNELS).name << ")\n";
+    cout << "-----------------------\n";
+
+    auto measure_point = [&](const string& load, int active, double target) {
+        LoadedPoint point;
+        point.load = load;
+        point.target = target;
+        vector<double> delivered;
+        double rate = target > 0 ? target * 1024 * 1024 * 1024 / (threads - 1) : 0;
+        point.latency = scale_stats(measure(measure_config, [&] {
+            double gb_per_s = 0;
+            double seconds = time_loaded_latency(pool, active, chase, traffic, chunk, kind, rate, gb_per_s);
+            delivered.push_back(gb_per_s);
+            return seconds;
+        }), 1e9 / LOADED_CHASE);
+        sort(delivered.begin(), delivered.end());
+        point.delivered = percentile(delivered, 0.5);
+        return point;
+    };
+
+    vector<LoadedPoint> points;
+    points.push_back(measure_point("idle", 1, 0));
+    LoadedPoint peak = measure_point("max", threads, 0);
+    for (int percent = 10; percent <= 90; percent += 10)
+        points.push_back(measure_point(to_string(percent) + "%", threads, peak.delivered * percent / 100));
+    points.push_back(peak);
+
+    // Records are keyed on the nominal load, so they match across runs
+    // whatever the peak measured this time.
+    cout << setw(8) << "Load" << setw(10) << "Injected" << setw(12) << "Delivered" << setw(12) << "Latency"
+         << setw(8) << "CI95" << "\n";
+    cout << setw(8) << "" << setw(10) << "GB/s" << setw(12) << "GB/s" << setw(12) << "ns" << "\n";
+    cout << fixed;
+    for (const LoadedPoint& point : points) {
+        cout << setw(8) << point.load << setprecision(2) << setw(10);
+        if (point.target > 0)
+            cout << point.target;
+        else
+            cout << "-";
+        cout << setw(12) << point.delivered << setprecision(1)
+             << setw(12) << point.latency.median << setw(7) << 100.0 * point.latency.ci << "%\n";
+        ResultParams params = {{"traffic", LOADED_TRAFFIC_NAMES[kind]}, {"injected", point.load}};
+        report.add_time("loaded", params, "load_latency", "ns", point.latency, 1.0);
+        if (point.target > 0)
+            report.add_value("loaded", params, "injected_bandwidth", "GB/s", point.target, true);
+        report.add_value("loaded", params, "delivered_bandwidth", "GB/s", point.delivered, true);
+    }
+
+    first_touch_free(chase, size);
+    first_touch_free(traffic, chunk * (threads - 1));
+    return 0;
+}
+
+//------------------------//
+// TLB reach
+//------------------------//
+
+// The line-granular random chase over growing working sets, once per page
+// backend. Past the reach of the L1/L2 TLBs every load adds a page walk, so
+// the gap between the 4 KiB and huge-page columns is what huge pages would
+// save a random-access workload of that size. Backends that can't be mapped
+// (no THP, empty hugetlb pool) are skipped with a note.
+int run_tlb_sweep(size_t max_size) {
+    pin_current_thread(thread_cpus[0]);
+    mt19937_64 rng(42);
+    double ghz = estimate_core_ghz();
+
+    vector<size_t> sizes;
+    for (size_t size = 16 * 1024; size <= max_size; size *= 2)
+        sizes.push_back(size);
+    vector<PageBackend> backends;
+    vector<vector<double>> latency;
+
+    cout << "TLB reach: random line loads, 16 KiB to " << format_size(max_size)
+         << ", core clock ~" << fixed << setprecision(2) << ghz << " GHz\n";
+    for (int b = 0; b < PAGE_BACKEND_COUNT; b++) {
+        PageBackend backend = PageBackend(b);
+        size_t huge_before = anon_huge_bytes();
+        char* memory = first_touch_alloc(max_size, 1, thread_cpus, backend);
+        if (!memory) {
+            cout << describe_pages(backend) << ": cannot map " << format_size(max_size) << ", skipped\n";
+            continue;
+        }
+        // What the kernel actually gave: THP is best effort.
+        size_t huge = backend == PAGES_HUGETLB_2M || backend == PAGES_HUGETLB_1G ? max_size
+                                                                                   : anon_huge_bytes() - huge_before;
+        cout << describe_pages(backend) << ": " << format_size(max_size) << ", "
+             << 100.0 * min(huge, max_size) / max_size << "% in huge pages\n";
+        report.add_value("tlb", {{"pages", PAGE_BACKEND_NAMES[backend]}}, "huge_page_coverage", "fraction",
+                         double(min(huge, max_size)) / max_size, true);
+
+        vector<double> column;
+        for (size_t size : sizes) {
+            SampleStats stats = measure_load_latency(memory, size, CACHE_LINE, rng);
+            ResultParams params = {{"pages", PAGE_BACKEND_NAMES[backend]}, {"size", format_size(size)}};
+            report.add_time("tlb", params, "load_latency", "ns", stats, 1.0);
+            report.add_value("tlb", params, "load_latency_cycles", "cycles", stats.median * ghz, false);
+            column.push_back(stats.median);
+        }
+        first_touch_free(memory, max_size, backend);
+        backends.push_back(backend);
+        latency.push_back(column);
+    }
+
+    cout << "-----------------------\n";
+    cout << "Median ns per load (cycles at the estimated clock in the JSON report)\n";
+    cout << setw(10) << "Size" << setw(6) << "Fits";
+    for (PageBackend backend : backends)
+        cout << setw(10) << PAGE_BACKEND_NAMES[backend];
+    cout << "\n";
+    for (size_t i = 0; i < sizes.size(); i++) {
+        cout << setw(10) << format_size(sizes[i]) << setw(6) << cpu_topology().fitting_level(sizes[i], 1);
+        for (size_t b = 0; b < backends.size(); b++)
+            cout << setw(10) << latency[b][i];
+        cout << "\n";
+    }
+    return 0;
+}
+
+//------------------------//
+// Random access (GUPS)
+//------------------------//
+
+// Random streams are xorshift64, which vectorizes with shifts and xors
+// alone; every seed must be non-zero.
+const int MAX_CHAINS = 64;
+const uint64_t RANDOM_OPS = 1 << 20; // updates or loads per thread per sample
+
+inline uint64_t xorshift64(uint64_t x) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+inline uint64_t chain_seed(uint64_t seed, int chain) {
+    return xorshift64(seed + (chain + 1) * 0x9E3779B97F4A7C15ULL);
+}
+
+// GUPS: table[r & mask] ^= r for a stream of random r, HPC Challenge
+// RandomAccess style. Addresses never depend on loaded data, so the core
+// overlaps as many misses as it can track. Threads share the table and
+// their rare colliding updates are allowed to race, as in HPCC.
+typedef uint64_t (*GupsKernel)(uint64_t* table, uint64_t mask, uint64_t updates, uint64_t seed);
+
+// Independent random loads with exactly `chains` misses in flight: each
+// chain's next address mixes in the word it just loaded, so a chain waits
+// for its own load and only the chains overlap. Vector kernels round
+// chains up to whole vectors.
+typedef uint64_t (*RandomLoadKernel)(const uint64_t* table, uint64_t mask, uint64_t loads, int chains, uint64_t seed);
+
+uint64_t gups_scalar(uint64_t* table, uint64_t mask, uint64_t updates, uint64_t seed) {
+    uint64_t r = chain_seed(seed, 0);
+    for (uint64_t i = 0; i < updates; i++) {
+        r = xorshift64(r);
+        table[r & mask] ^= r;
+    }
+    return r;
+}
+
+uint64_t random_loads_scalar(const uint64_t* table, uint64_t mask, uint64_t loads, int chains, uint64_t seed) {
+    uint64_t r[MAX_CHAINS];
+    for (int c = 0; c < chains; c++)
+        r[c] = chain_seed(seed, c);
+    for (uint64_t i = 0; i < loads; i += chains)
+        for (int c = 0; c < chains; c++)
+            r[c] = xorshift64(r[c]) + table[r[c] & mask];
+    uint64_t result = 0;
+    for (int c = 0; c < chains; c++)
+        result ^= r[c];
+    return result;
+}
+
+ISA_AVX2 inline __m256i xorshift64_avx2(__m256i x) {
+    x = _mm256_xor_si256(x, _mm256_slli_epi64(x, 13));
+    x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 7));
+    return _mm256_xor_si256(x, _mm256_slli_epi64(x, 17));
+}
+
+ISA_AVX2 inline __m256i chain_seeds_avx2(uint64_t seed, int first) {
+    return _mm256_setr_epi64x(chain_seed(seed, first), chain_seed(seed, first + 1), chain_seed(seed, first + 2),
+                              chain_seed(seed, first + 3));
+}
+
+// AVX2 gathers but has no scatter: the four updated words are stored one
+// by one.
+ISA_AVX2 uint64_t gups_avx2(uint64_t* table, uint64_t mask, uint64_t updates, uint64_t seed) {
+    __m256i r = chain_seeds_avx2(seed, 0);
+    __m256i vmask = _mm256_set1_epi64x(mask);
+    alignas(32) uint64_t index[4], value[4];
+    for (uint64_t i = 0; i < updates; i += 4) {
+        r = xorshift64_avx2(r);
+        __m256i idx = _mm256_and_si256(r, vmask);
+        __m256i old = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(table), idx, 8);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(index), idx);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(value), _mm256_xor_si256(old, r));
+        for (int lane = 0; lane < 4; lane++)
+            table[index[lane]] = value[lane];
+    }
+    return _mm256_extract_epi64(r, 0);
+}
+
+ISA_AVX2 uint64_t random_loads_avx2(const uint64_t* table, uint64_t mask, uint64_t loads, int chains, uint64_t seed) {
+    int vectors = (chains + 3) / 4;
+    __m256i r[MAX_CHAINS / 4];
+    for (int v = 0; v < vectors; v++)
+        r[v] = chain_seeds_avx2(seed, 4 * v);
+    __m256i vmask = _mm256_set1_epi64x(mask);
+    for (uint64_t i = 0; i < loads; i += 4 * vectors) {
+        for (int v = 0; v < vectors; v++) {
+            __m256i loaded = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(table),
+                                                    _mm256_and_si256(r[v], vmask), 8);
+            r[v] = _mm256_add_epi64(xorshift64_avx2(r[v]), loaded);
+        }
+    }
+    __m256i result = _mm256_setzero_si256();
+    for (int v = 0; v < vectors; v++)
+        result = _mm256_xor_si256(result, r[v]);
+    return _mm256_extract_epi64(result, 0);
+}
+
+// GCC's AVX-512 shift and gather intrinsics start from an undefined
+// vector that -Wall reports as maybe-uninitialized after inlining.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+ISA_AVX512 inline __m512i xorshift64_avx512(__m512i x) {
+    x = _mm512_xor_si512(x, _mm512_slli_epi64(x, 13));
+    x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 7));
+    return _mm512_xor_si512(x, _mm512_slli_epi64(x, 17));
+}
+
+ISA_AVX512 inline __m512i chain_seeds_avx512(uint64_t seed, int first) {
+    alignas(64) uint64_t seeds[8];
+    for (int lane = 0; lane < 8; lane++)
+        seeds[lane] = chain_seed(seed, first + lane);
+    return _mm512_load_si512(seeds);
+}
+
+// Gather, xor, scatter. Two lanes hitting the same word in one vector lose
+// one update, as racing threads do.
+ISA_AVX512 uint64_t gups_avx512(uint64_t* table, uint64_t mask, uint64_t updates, uint64_t seed) {
+    __m512i r = chain_seeds_avx512(seed, 0);
+    __m512i vmask = _mm512_set1_epi64(mask);
+    for (uint64_t i = 0; i < updates; i += 8) {
+        r = xorshift64_avx512(r);
+        __m512i idx = _mm512_and_si512(r, vmask);
+        __m512i old = _mm512_i64gather_epi64(idx, table, 8);
+        _mm512_i64scatter_epi64(table, idx, _mm512_xor_si512(old, r), 8);
+    }
+    return _mm_cvtsi128_si64(_mm512_castsi512_si128(r));
+}
+
+ISA_AVX512 uint64_t random_loads_avx512(const uint64_t* table, uint64_t mask, uint64_t loads, int chains, uint64_t seed) {
+    int vectors = (chains + 7) / 8;
+    __m512i r[MAX_CHAINS / 8];
+    for (int v = 0; v < vectors; v++)
+        r[v] = chain_seeds_avx512(seed, 8 * v);
+    __m512i vmask = _mm512_set1_epi64(mask);
+    for (uint64_t i = 0; i < loads; i += 8 * vectors) {
+        for (int v = 0; v < vectors; v++) {
+            __m512i loaded = _mm512_i64gather_epi64(_mm512_and_si512(r[v], vmask), table, 8);
+            r[v] = _mm512_add_epi64(xorshift64_avx512(r[v]), loaded);
+        }
+    }
+    __m512i result = _mm512_setzero_si512();
+    for (int v = 0; v < vectors; v++)
+        result = _mm512_xor_si512(result, r[v]);
+    return _mm_cvtsi128_si64(_mm512_castsi512_si128(result));
+}
+#pragma GCC diagnostic pop
+
+struct RandomKernel {
+    const char* name;
+    FeatureMask required;
+    int lanes;
+    GupsKernel gups;
+    RandomLoadKernel loads;
+};
+
+const RandomKernel RANDOM_KERNELS[] = {
+    { "Scalar",  0,            1, gups_scalar, random_loads_scalar },
+    { "AVX2",    NEEDS_AVX2,   4, gups_avx2,   random_loads_avx2 },
+    { "AVX-512", NEEDS_AVX512, 8, gups_avx512, random_loads_avx512 },
+};
+
+volatile uint64_t random_sink; // keeps the kernels' final values live
+
+// GUPS and the chained random loads over one table shared by all threads,
+// for each thread count of the sweep and each kernel. `chains` fixes the
+// misses in flight per thread; 0 sweeps 1, 2, 4, ... 32. Rates are in
+// millions per second over all threads. Effective bandwidth counts the
+// bytes asked for: 8 read and 8 written per update, 8 per load; whole
+// lines move underneath, so DRAM traffic is up to 8x that.
+int run_random_access(WorkerPool& pool, size_t size, int chains) {
+    size_t words = 1;
+    while (words * 2 * sizeof(uint64_t) <= size)
+        words *= 2;
+    size = words * sizeof(uint64_t);
+    uint64_t mask = words - 1;
+
+    int max_threads = thread_cpus.size();
+    uint64_t* table = reinterpret_cast<uint64_t*>(first_touch_alloc(size, max_threads, thread_cpus));
+    if (!table) {
+        cerr << "Cannot allocate " << format_size(size) << "\n";
+        return 1;
+    }
+    uint64_t fill = 1;
+    for (size_t i = 0; i < words; i++)
+        table[i] = fill = xorshift64(fill);
+
+    vector<int> chain_counts;
+    if (chains > 0)
+        chain_counts.push_back(min(chains, MAX_CHAINS));
+    else
+        for (int c = 1; c <= 32; c *= 2)
+            chain_counts.push_back(c);
+    vector<RandomKernel> kernels = supported_entries(RANDOM_KERNELS);
+
+    cout << "Random access over a " << format_size(size) << " table (" << cpu_topology().fitting_level(size, 1)
+         << "), " << RANDOM_OPS << " per thread per sample\n";
+    cout << "Median M/s and effective GB/s over all threads; loads xN keep N misses in flight per thread\n";
+    cout << "-----------------------\n";
+
+    for (int threads : sweep_thread_counts(max_threads)) {
+        cout << "Threads: " << threads << "\n";
+        cout << left << setw(10) << "Access" << right;
+        for (const RandomKernel& k : kernels)
+            cout << setw(12) << string(k.name) + " M/s" << setw(8) << "GB/s";
+        cout << "\n" << fixed << setprecision(2);
+
+        for (size_t row = 0; row <= chain_counts.size(); row++) {
+            bool gups = row == 0;
+            int requested = gups ? 0 : chain_counts[row - 1];
+            cout << left << setw(10) << (gups ? string("GUPS") : "loads x" + to_string(requested)) << right;
+            for (const RandomKernel& k : kernels) {
+                int used = (requested + k.lanes - 1) / k.lanes * k.lanes;
+                perf.reset();
+                SampleStats stats = measure(measure_config, [&] {
+                    return pool.run(threads, [&](int i) {
+                        perf.start(i);
+                        if (gups)
+                            random_sink = k.gups(table, mask, RANDOM_OPS, i + 1);
+                        else
+                            random_sink = k.loads(table, mask, RANDOM_OPS, used, i + 1);
+                        perf.stop(i);
+                    });
+                });
+                PerfSample counters = perf.total(threads);
+
+                double ops = double(RANDOM_OPS) * threads;
+                double bytes = ops * (gups ? 16 : 8);
+                ResultParams params = {{"threads", to_string(threads)}, {"kernel", k.name},
+                                       {"access", gups ? "gups" : "loads"}};
+                if (!gups)
+                    params.push_back({"chains", to_string(used)});
+                report.add_rate("random", params, gups ? "update_rate" : "load_rate", "M/s", stats, ops / 1e6);
+                report.add_rate("random", params, "effective_bandwidth", "GB/s", stats, gigabytes(bytes));
+                report.add_perf("random", params, counters);
+                report.add_cycles("random", params, cycle_stats(stats, counters, RANDOM_OPS, threads),
+                                  gups ? "update" : "load");
+                cout << setw(12) << ops / 1e6 / stats.median << setw(8) << gigabytes(bytes) / stats.median;
+            }
+            cout << "\n";
+        }
+        cout << "-----------------------\n";
+    }
+
+    first_touch_free(reinterpret_cast<char*>(table), size);
+    return 0;
+}
+
+//------------------------//
+// Cache-level bandwidth sweep
+//------------------------//
+
+// Runs every kernel over per-thread working sets from 4 KiB up to an equal
+// share of `size`, so the curve steps down at each cache level.
+int run_cache_sweep(WorkerPool& pool, size_t size) {
+    const size_t bytes_per_point = 256ULL * 1024 * 1024; // per thread, per timed run
+
+    cout << "Bandwidth sweep, median aggregate GB/s over all threads\n";
+    cout << "-----------------------\n";
+
+    vector<MemKernel> kernels = supported_entries(MEM_KERNELS);
+    for (int threads : sweep_thread_counts(thread_cpus.size())) {
+        cout << "Threads: " << threads << "\n";
+        cout << setw(10) << "Per-thread" << setw(6) << "Fits";
+        for (const MemKernel& k : kernels)
+            cout << setw(10) << string(k.name) + " R" << setw(10) << string(k.name) + " W";
+        cout << "\n" << fixed << setprecision(2);
+
+        for (size_t working_set = 4096; working_set * threads <= size; working_set *= 2) {
+            size_t total = working_set * threads;
+            size_t reps = max<size_t>(1, bytes_per_point / working_set);
+            char* memory = first_touch_alloc(total, threads, thread_cpus);
+            if (!memory) {
+                cerr << "Cannot allocate " << format_size(total) << "\n";
+                return 1;
+            }
+            double gb = gigabytes(total * reps);
+            cout << setw(10) << format_size(working_set) << setw(6) << cpu_topology().fitting_level(working_set, threads);
+            for (const MemKernel& k : kernels) {
+                ResultParams params = {{"threads", to_string(threads)}, {"working_set", format_size(working_set)},
+                                       {"kernel", k.name}};
+                SampleStats read = measure_read_bandwidth(pool, memory, total, threads, k.read, reps);
+                PerfSample read_counters = perf.total(threads);
+                SampleStats write = measure_write_bandwidth(pool, memory, total, threads, k.write, reps);
+                PerfSample write_counters = perf.total(threads);
+                report.add_rate("sweep", params, "read_bandwidth", "GB/s", read, gb);
+                report.add_rate("sweep", params, "write_bandwidth", "GB/s", write, gb);
+                report_line_cycles("sweep", with_param(params, "access", "read"), read, read_counters,
+                                   double(working_set) * reps, threads);
+                report_line_cycles("sweep", with_param(params, "access", "write"), write, write_counters,
+                                   double(working_set) * reps, threads);
+                cout << setw(10) << gb / read.median << setw(10) << gb / write.median;
+            }
+            cout << endl;
+            first_touch_free(memory, total);
+        }
+        cout << "-----------------------\n";
+    }
+
+    return 0;
+}
+
+//------------------------//
+// Access patterns and prefetchers
+//------------------------//
+
+// Read and write samples of one thread walking `size` bytes in `pattern`
+// with the widest kernel; `bytes` counts only what the accesses touch.
+struct PatternResult {
+    SampleStats read, write;
+    double accesses = 0;
+    double bytes = 0;
+};
+
+PatternResult measure_pattern(WorkerPool& pool, char* memory, size_t size, const AccessPattern& pattern,
+                              const ResultParams& params) {
+    const MemKernel& k = widest_entry(MEM_KERNELS);
+    PatternResult result;
+    result.accesses = pattern.accesses(size, k.width);
+    result.bytes = result.accesses * k.width;
+    result.read = measure_read_bandwidth(pool, memory, size, 1, k.read, 1, pattern);
+    report_line_cycles("pattern", with_param(params, "access", "read"), result.read, perf.total(1),
+                       result.accesses * CACHE_LINE, 1);
+    result.write = measure_write_bandwidth(pool, memory, size, 1, k.write, 1, pattern);
+    report_line_cycles("pattern", with_param(params, "access", "write"), result.write, perf.total(1),
+                       result.accesses * CACHE_LINE, 1);
+    report.add_time("pattern", with_param(params, "access", "read"), "access_time", "ns", result.read,
+                    1e9 / result.accesses);
+    report.add_time("pattern", with_param(params, "access", "write"), "access_time", "ns", result.write,
+                    1e9 / result.accesses);
+    report.add_rate("pattern", with_param(params, "access", "read"), "bandwidth", "GB/s", result.read,
+                    gigabytes(result.bytes));
+    report.add_rate("pattern", with_param(params, "access", "write"), "bandwidth", "GB/s", result.write,
+                    gigabytes(result.bytes));
+    return result;
+}
+
+// One thread, widest kernel, over `size` bytes of DRAM-sized buffer:
+// - strides of one line up to 8 KiB, forward and reverse: while the
+//   prefetchers keep up an access costs a fraction of a miss; the stride
+//   where it climbs to the page-stride cost (streamers stay within a 4 KiB
+//   page) is where hardware prefetching stops helping;
+// - 1..64 concurrent forward streams of consecutive lines: bandwidth holds
+//   while the prefetchers track every stream and drops past that count.
+// With `prefetch` > 0 both tables add the same walks with software
+// prefetch that many bytes ahead.
+int run_access_patterns(WorkerPool& pool, size_t size, size_t prefetch) {
+    const MemKernel& k = widest_entry(MEM_KERNELS);
+    char* memory = first_touch_alloc(size, 1, thread_cpus);
+    if (!memory) {
+        cerr << "Cannot allocate " << format_size(size) << "\n";
+        return 1;
+    }
+    cout << "Access patterns: one thread, " << k.name << " kernel, " << format_size(size) << " buffer";
+    if (prefetch)
+        cout << ", software prefetch " << prefetch << " B ahead in the +pf columns";
+    cout << "\n-----------------------\n";
+
+    cout << "Median ns per access by stride\n";
+    cout << setw(8) << "Stride" << setw(10) << "Read" << setw(10) << "Reverse" << setw(10) << "Write"
+         << setw(10) << "Rev write";
+    if (prefetch)
+        cout << setw(10) << "Read+pf" << setw(10) << "Rev+pf";
+    cout << "\n" << fixed << setprecision(2);
+
+    vector<size_t> strides;
+    vector<double> read_ns;
+    for (size_t stride = CACHE_LINE; stride <= 8192; stride *= 2) {
+        vector<double> row;
+        for (int pf = 0; pf <= (prefetch ? 1 : 0); pf++) {
+            for (int reverse = 0; reverse <= 1; reverse++) {
+                AccessPattern pattern;
+                pattern.stride = stride;
+                pattern.reverse = reverse;
+                pattern.prefetch = pf ? prefetch : 0;
+                ResultParams params = {{"stride", to_string(stride)}, {"direction", reverse ? "reverse" : "forward"},
+                                       {"prefetch", to_string(pattern.prefetch)}};
+                PatternResult r = measure_pattern(pool, memory, size, pattern, params);
+                row.push_back(r.read.median * 1e9 / r.accesses);
+                if (!pf)
+                    row.push_back(r.write.median * 1e9 / r.accesses);
+            }
+        }
+        // Measured as read, write, reverse read, reverse write[, read+pf, reverse read+pf].
+        cout << setw(8) << stride << setw(10) << row[0] << setw(10) << row[2] << setw(10) << row[1]
+             << setw(10) << row[3];
+        if (prefetch)
+            cout << setw(10) << row[4] << setw(10) << row[5];
+        cout << "\n";
+        strides.push_back(stride);
+        read_ns.push_back(row[0]);
+    }
+
+    // First stride whose forward read costs at least 80% of the page stride.
+    size_t page = find(strides.begin(), strides.end(), 4096) - strides.begin();
+    if (page < strides.size()) {
+        size_t limit = 0;
+        while (limit < page && read_ns[limit] < 0.8 * read_ns[page])
+            limit++;
+        cout << "Hardware prefetch stops helping at a " << strides[limit] << " B stride\n";
+        report.add_value("pattern", {}, "prefetch_limit_stride", "B", strides[limit], true);
+    }
     cout << "-----------------------\n";
 
-    auto scalar_write = write_memory_chunk_scalar;
-    auto sse_write = write_memory_chunk_sse;
-    auto avx_write = write_memory_chunk_avx;
-    auto scalar_read = read_memory_chunk_scalar;
-    auto sse_read = read_memory_chunk_sse;
-    auto avx_read = read_memory_chunk_avx;
+    cout << "Median GB/s by concurrent streams (consecutive lines in each)\n";
+    cout << setw(8) << "Streams" << setw(10) << "Read" << setw(10) << "Write";
+    if (prefetch)
+        cout << setw(10) << "Read+pf";
+    cout << "\n";
+
+    vector<int> stream_counts;
+    vector<double> read_gbs;
+    for (int streams = 1; streams <= 64; streams *= 2) {
+        AccessPattern pattern;
+        pattern.stride = CACHE_LINE;
+        pattern.streams = streams;
+        ResultParams params = {{"streams", to_string(streams)}, {"prefetch", "0"}};
+        PatternResult r = measure_pattern(pool, memory, size, pattern, params);
+        double read = gigabytes(r.bytes) / r.read.median;
+        cout << setw(8) << streams << setw(10) << read << setw(10) << gigabytes(r.bytes) / r.write.median;
+        if (prefetch) {
+            pattern.prefetch = prefetch;
+            PatternResult pf = measure_pattern(pool, memory, size, pattern, with_param(params, "prefetch", to_string(prefetch)));
+            cout << setw(10) << gigabytes(pf.bytes) / pf.read.median;
+        }
+        cout << "\n";
+        stream_counts.push_back(streams);
+        read_gbs.push_back(read);
+    }
+
+    // Last count before read bandwidth falls below 80% of the best.
+    double best = *max_element(read_gbs.begin(), read_gbs.end());
+    size_t tracked = max_element(read_gbs.begin(), read_gbs.end()) - read_gbs.begin();
+    while (tracked + 1 < read_gbs.size() && read_gbs[tracked + 1] >= 0.8 * best)
+        tracked++;
+    cout << "Prefetchers keep up with " << stream_counts[tracked] << " streams\n";
+    report.add_value("pattern", {}, "tracked_streams", "streams", stream_counts[tracked], true);
+
+    first_touch_free(memory, size);
+    return 0;
+}
+
+//------------------------//
+// STREAM benchmark
+//------------------------//
+
+struct StreamVariant {
+    const char* isa;
+    FeatureMask required;
+    bool non_temporal;
+    StreamKernel kernels[4];
+};
+
+#define STREAM_VARIANT(isa_name, required, suffix, nt) \
+    { isa_name, required, nt, { stream_kernel_##suffix<STREAM_COPY, nt>, stream_kernel_##suffix<STREAM_SCALE, nt>, \
+                      stream_kernel_##suffix<STREAM_ADD, nt>, stream_kernel_##suffix<STREAM_TRIAD, nt> } }
+
+const StreamVariant STREAM_VARIANTS[] = {
+    STREAM_VARIANT("Scalar", 0, scalar, false),             STREAM_VARIANT("Scalar", 0, scalar, true),
+    STREAM_VARIANT("SSE", 0, sse, false),                   STREAM_VARIANT("SSE", 0, sse, true),
+    STREAM_VARIANT("AVX", NEEDS_AVX, avx, false),           STREAM_VARIANT("AVX", NEEDS_AVX, avx, true),
+    STREAM_VARIANT("AVX-512", NEEDS_AVX512, avx512, false), STREAM_VARIANT("AVX-512", NEEDS_AVX512, avx512, true),
+};
+
+// Seconds for one pass of `kernel` over `chunk` elements per thread. Chunks
+// must be whole cache lines so every thread's slice stays 64-byte aligned.
+double time_stream_kernel(WorkerPool& pool, StreamKernel kernel, double* a, double* b, double* c, size_t chunk,
+                          int thread_count, size_t prefetch) {
+    return pool.run(thread_count, [=](int i) {
+        perf.start(i);
+        kernel(a + i * chunk, b + i * chunk, c + i * chunk, 3.0, chunk, prefetch);
+        perf.stop(i);
+    });
+}
+
+// STREAM-style report: best rate over the samples, after the warmup passes.
+int run_stream(WorkerPool& pool, size_t array_size, size_t prefetch_bytes) {
+    size_t n = array_size / sizeof(double) / 8 * 8;
+
+    vector<StreamVariant> variants = supported_entries(STREAM_VARIANTS);
+
+    cout << "STREAM: " << n << " doubles per array (" << format_size(n * sizeof(double)) << "), "
+         << "prefetch distance " << prefetch_bytes << " B, best rate in MB/s\n";
+    cout << "-----------------------\n";
+    cout << fixed << setprecision(1);
+
+    for (int threads : sweep_thread_counts(thread_cpus.size())) {
+        // Arrays are re-allocated per thread count so each slice is first
+        // touched, and therefore placed, by the thread that streams it.
+        size_t chunk = n / threads / 8 * 8;
+        size_t bytes = chunk * threads * sizeof(double);
+        double* a = reinterpret_cast<double*>(first_touch_alloc(bytes, threads, thread_cpus));
+        double* b = reinterpret_cast<double*>(first_touch_alloc(bytes, threads, thread_cpus));
+        double* c = reinterpret_cast<double*>(first_touch_alloc(bytes, threads, thread_cpus));
+        if (!a || !b || !c) {
+            cerr << "Cannot allocate 3 x " << format_size(bytes) << "\n";
+            return 1;
+        }
+        for (size_t i = 0; i < chunk * threads; i++) {
+            a[i] = 1.0;
+            b[i] = 2.0;
+            c[i] = 0.0;
+        }
+
+        cout << "Threads: " << threads << "\n";
+        cout << setw(10) << "ISA" << setw(10) << "Stores";
+        for (const char* name : STREAM_NAMES)
+            cout << setw(12) << name;
+        cout << "\n";
+        for (const StreamVariant& v : variants) {
+            cout << setw(10) << v.isa << setw(10) << (v.non_temporal ? "NT" : "regular");
+            for (int op = 0; op < 4; op++) {
+                perf.reset();
+                SampleStats stats = measure(measure_config, [&] {
+                    return time_stream_kernel(pool, v.kernels[op], a, b, c, chunk, threads, prefetch_bytes / sizeof(double));
+                });
+                double mb = 1e-6 * STREAM_BYTES_PER_ELEMENT[op] * chunk * threads;
+                ResultParams params = {{"threads", to_string(threads)}, {"isa", v.isa},
+                                       {"stores", v.non_temporal ? "NT" : "regular"}, {"op", STREAM_NAMES[op]}};
+                report.add_rate("stream", params, "bandwidth", "MB/s", stats, mb);
+                PerfSample counters = perf.total(threads);
+                report.add_perf("stream", params, counters);
+                report.add_cycles("stream", params, cycle_stats(stats, counters, chunk, threads), "element");
+                cout << setw(12) << mb / stats.min;
+            }
+            cout << endl;
+        }
+        cout << "-----------------------\n";
+
+        first_touch_free(reinterpret_cast<char*>(a), bytes);
+        first_touch_free(reinterpret_cast<char*>(b), bytes);
+        first_touch_free(reinterpret_cast<char*>(c), bytes);
+    }
+
+    return 0;
+}
+
+//------------------------//
+// NUMA matrix
+//------------------------//
+
+// Read bandwidth from all CPUs of one node, and single-thread latency, against
+// memory first touched on every node in turn. Memory-only nodes have no CPU
+// to first-touch from and are skipped.
+int run_numa_matrix(size_t size) {
+    vector<LogicalCpu> topology = read_cpu_topology();
+    vector<int> nodes = topology_nodes(topology);
+    mt19937_64 rng(42);
+
+    vector<vector<double>> bandwidth(nodes.size(), vector<double>(nodes.size()));
+    vector<vector<double>> latency(nodes.size(), vector<double>(nodes.size()));
+
+    for (size_t m = 0; m < nodes.size(); m++) {
+        vector<int> memory_cpus = node_cpus(topology, nodes[m]);
+        char* memory = first_touch_alloc(size, 1, memory_cpus);
+        if (!memory) {
+            cerr << "Cannot allocate " << format_size(size) << "\n";
+            return 1;
+        }
+        for (size_t c = 0; c < nodes.size(); c++) {
+            vector<int> cpus = node_cpus(topology, nodes[c]);
+            WorkerPool node_pool(cpus);
+            int threads = cpus.size();
+            size_t bytes = whole_chunks(size, threads);
+            SampleStats read = measure_read_bandwidth(node_pool, memory, bytes, threads, widest_entry(MEM_KERNELS).read);
+            bandwidth[c][m] = gigabytes(bytes) / read.median;
+
+            pin_current_thread(cpus[0]);
+            SampleStats chase = measure_load_latency(memory, size, CACHE_LINE, rng);
+            latency[c][m] = chase.median;
+
+            ResultParams params = {{"cpu_node", to_string(nodes[c])}, {"memory_node", to_string(nodes[m])}};
+            report.add_rate("numa", params, "read_bandwidth", "GB/s", read, gigabytes(bytes));
+            report.add_cycles("numa", params, cycle_stats(read, PerfSample(), bytes / 64.0 / threads, threads), "line");
+            report.add_time("numa", params, "load_latency", "ns", chase, 1.0);
+        }
+        first_touch_free(memory, size);
+    }
+
+    auto print_matrix = [&](const char* title, const vector<vector<double>>& values) {
+        cout << title << " (rows: CPU node, columns: memory node)\n";
+        cout << setw(8) << "";
+        for (int node : nodes)
+            cout << setw(10) << ("node" + to_string(node));
+        cout << "\n";
+        for (size_t c = 0; c < nodes.size(); c++) {
+            cout << setw(8) << ("node" + to_string(nodes[c]));
+            for (size_t m = 0; m < nodes.size(); m++)
+                cout << setw(10) << values[c][m];
+            cout << "\n";
+        }
+        cout << "-----------------------\n";
+    };
+
+    cout << "NUMA matrix over " << format_size(size) << " per node pair\n";
+    cout << "-----------------------\n";
+    cout << fixed << setprecision(2);
+    print_matrix("Median read bandwidth GB/s, all CPUs of the node", bandwidth);
+    print_matrix("Median load latency ns, one thread", latency);
+    return 0;
+}
+
+// Usage: mem_bench_2             streaming bandwidth over the memory working set
+//        mem_bench_2 latency [max MiB]   pointer-chase latency sweep (default 2x the memory working set)
+//        mem_bench_2 loaded [MiB] [read|write|mixed]
+//                                        chase latency on the first CPU while the others inject
+//                                        paced traffic: latency vs delivered bandwidth (default
+//                                        memory working set, read traffic)
+//        mem_bench_2 sweep [MiB]         per-thread working-set sweep within MiB (default memory working set)
+//        mem_bench_2 stream [MiB] [pf B] STREAM Copy/Scale/Add/Triad, MiB per array (default memory
+//                                        working set), optional software prefetch distance in bytes
+//        mem_bench_2 numa [MiB]          local vs remote node bandwidth/latency (default memory working set)
+//        mem_bench_2 tlb [max MiB]       random-load latency per page backend and working set
+//                                        (default memory working set)
+//        mem_bench_2 pattern [MiB] [pf B] one-thread strided/reverse reads and writes and 1..64
+//                                        concurrent streams, optional software prefetch distance
+//                                        in bytes (default memory working set, no prefetch)
+//        mem_bench_2 random [MiB] [N]    GUPS and random loads with N misses in flight per thread
+//                                        (default 1..32), scalar and AVX2/AVX-512 gather/scatter,
+//                                        over a table of MiB (default memory working set)
+// The memory working set is sized from the cache topology (cpu_topology.h):
+// four times all caches, at least 256 MiB.
+// Options: --affinity=scatter|compact|physical|none|<cpu list> (default scatter)
+//          --pages=default|nothp|thp|2m|1g for every buffer (default: plain mmap, system THP policy)
+//          --warmup=N --reps=N | --min-reps=N --max-reps=N --max-time=S --ci=PCT, --outliers=K
+//          --json=FILE --csv=FILE --compare=BASELINE.json --threshold=PCT, --timer=tsc|steady
+int main(int argc, char** argv) {
+    report.init("mem_bench_2", argc, argv);
+    AffinityConfig affinity;
+    thread_cpus = affinity_from_args(argc, argv, affinity);
+    pages_from_args(argc, argv);
+    measure_config_from_args(argc, argv, measure_config);
+    timer_from_args(argc, argv);
+    report.set_placement(affinity, thread_cpus);
+    report.set_sampling(measure_config);
+    cout << "CPU: " << cpu_info().brand << "\n";
+    cout << "Features: " << feature_list(cpu_info().features) << "\n";
+    cout << describe_measure_config(measure_config) << "\n";
+    cout << describe_timer() << "\n";
+    cout << describe_topology(cpu_topology()) << "\n";
+    cout << describe_affinity(affinity, thread_cpus) << "\n";
+    cout << describe_pages(page_backend()) << "\n";
+    WorkerPool pool(thread_cpus);
+    perf.open(pool);
+    cout << perf.describe() << "\n";
+    size_t working_set = cpu_topology().memory_working_set();
+
+    if (argc > 1 && string(argv[1]) == "latency") {
+        size_t max_size = argc > 2 ? stoull(argv[2]) * 1024 * 1024 : 2 * working_set;
+        return report.finish(run_latency_sweep(max_size));
+    }
+    if (argc > 1 && string(argv[1]) == "loaded") {
+        size_t size = argc > 2 ? stoull(argv[2]) * 1024 * 1024 : working_set;
+        string traffic = argc > 3 ? argv[3] : "read";
+        size_t kind = find(begin(LOADED_TRAFFIC_NAMES), end(LOADED_TRAFFIC_NAMES), traffic) - begin(LOADED_TRAFFIC_NAMES);
+        if (kind == 3) {
+            cerr << "Unknown traffic '" << traffic << "', expected read, write or mixed\n";
+            return report.finish(1);
+        }
+        return report.finish(run_loaded_latency(pool, size, LoadedTraffic(kind)));
+    }
+    if (argc > 1 && string(argv[1]) == "sweep") {
+        size_t size = argc > 2 ? stoull(argv[2]) * 1024 * 1024 : working_set;
+        return report.finish(run_cache_sweep(pool, size));
+    }
+    if (argc > 1 && string(argv[1]) == "stream") {
+        size_t size = argc > 2 ? stoull(argv[2]) * 1024 * 1024 : working_set;
+        size_t prefetch = argc > 3 ? stoull(argv[3]) : 0;
+        return report.finish(run_stream(pool, size, prefetch));
+    }
+    if (argc > 1 && string(argv[1]) == "tlb") {
+        size_t max_size = argc > 2 ? stoull(argv[2]) * 1024 * 1024 : working_set;
+        return report.finish(run_tlb_sweep(max_size));
+    }
+    if (argc > 1 && string(argv[1]) == "pattern") {
+        size_t size = argc > 2 ? stoull(argv[2]) * 1024 * 1024 : working_set;
+        size_t prefetch = argc > 3 ? stoull(argv[3]) : 0;
+        return report.finish(run_access_patterns(pool, size, prefetch));
+    }
+    if (argc > 1 && string(argv[1]) == "random") {
+        size_t size = argc > 2 ? stoull(argv[2]) * 1024 * 1024 : working_set;
+        int chains = argc > 3 ? stoi(argv[3]) : 0;
+        return report.finish(run_random_access(pool, size, chains));
+    }
+    if (argc > 1 && string(argv[1]) == "numa") {
+        size_t size = argc > 2 ? stoull(argv[2]) * 1024 * 1024 : working_set;
+        return report.finish(run_numa_matrix(size));
+    }
+
+    size_t size = working_set;
+
+    int max_threads = thread_cpus.size();
+
+    cout << format_size(size) << " test on " << max_threads << " threads, median GB/s\n";
+    cout << "-----------------------\n";
+
+    vector<MemKernel> kernels = supported_entries(MEM_KERNELS);
 
     for (int threads = 1; threads <= max_threads; threads++) {
-        double total_scalar_write = 0.0, total_scalar_read = 0.0;
-        double total_sse_write = 0.0, total_sse_read = 0.0;
-        double total_avx_write = 0.0, total_avx_read = 0.0;
-        for (int i = 0; i < iterations; i++) {
-            total_scalar_write += measure_write_bandwidth(memory, size, threads, scalar_write);
-            total_scalar_read  += measure_read_bandwidth(memory, size, threads, scalar_read);
-            total_sse_write    += measure_write_bandwidth(memory, size, threads, sse_write);
-            total_sse_read     += measure_read_bandwidth(memory, size, threads, sse_read);
-            total_avx_write    += measure_write_bandwidth(memory, size, threads, avx_write);
-            total_avx_read     += measure_read_bandwidth(memory, size, threads, avx_read);
+        char* memory = first_touch_alloc(size, threads, thread_cpus);
+        if (!memory) {
+            cerr << "Cannot allocate " << format_size(size) << "\n";
+            return report.finish(1);
         }
         cout << "Threads: " << threads << "\n";
-        cout << "Scalar: Read = " << total_scalar_read / iterations << " GB/s, Write = " 
-             << total_scalar_write / iterations << " GB/s\n";
-        cout << "SSE   : Read = " << total_sse_read / iterations << " GB/s, Write = " 
-             << total_sse_write / iterations << " GB/s\n";
-        cout << "AVX   : Read = " << total_avx_read / iterations << " GB/s, Write = " 
-             << total_avx_write / iterations << " GB/s\n";
+        size_t bytes = whole_chunks(size, threads);
+        for (const MemKernel& k : kernels) {
+            SampleStats read = measure_read_bandwidth(pool, memory, size, threads, k.read);
+            PerfSample read_counters = perf.total(threads);
+            SampleStats write = measure_write_bandwidth(pool, memory, size, threads, k.write);
+            PerfSample write_counters = perf.total(threads);
+            ResultParams params = {{"threads", to_string(threads)}, {"kernel", k.name}};
+            report.add_rate("bandwidth", params, "read_bandwidth", "GB/s", read, gigabytes(bytes));
+            report.add_rate("bandwidth", params, "write_bandwidth", "GB/s", write, gigabytes(bytes));
+            CycleStats read_cycles = report_line_cycles("bandwidth", with_param(params, "access", "read"), read,
+                                                        read_counters, double(bytes) / threads, threads);
+            CycleStats write_cycles = report_line_cycles("bandwidth", with_param(params, "access", "write"), write,
+                                                         write_counters, double(bytes) / threads, threads);
+            cout << left << setw(8) << k.name << right << ": Read  = " << format_rate_stats(read, gigabytes(bytes)) << "\n"
+                 << setw(18) << "" << format_cycles(read_cycles, "line") << "\n";
+            if (perf.available())
+                cout << setw(18) << "" << format_perf(read_counters) << "\n";
+            cout << setw(8) << "" << "  Write = " << format_rate_stats(write, gigabytes(bytes)) << "\n"
+                 << setw(18) << "" << format_cycles(write_cycles, "line") << "\n";
+            if (perf.available())
+                cout << setw(18) << "" << format_perf(write_counters) << "\n";
+        }
         cout << "-----------------------\n";
+        first_touch_free(memory, size);
     }
 
     cout << "Done.\n";
-    delete[] memory;
     cin.get(); // Pause before exit
-    return 0;
+    return report.finish(0);
 }
@@ -0,0 +1,313 @@
+#pragma once
+
+// Hardware performance counters around timed regions, via perf_event_open.
+// Every worker opens its own counters (they count the calling thread only,
+// user space only) in two groups: core events {cycles, instructions,
+// branch-misses, stalled cycles} and memory events {L1D, LLC and dTLB read
+// misses}, so each group fits the programmable counters even with SMT on.
+// Events the CPU or kernel doesn't offer are left out; if none can be
+// opened (no PMU in a VM, perf_event_paranoid too high, not Linux) every
+// call becomes a no-op and the benchmarks print throughput only.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "affinity.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum PerfCounter {
+    PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_STALLED_CYCLES,
+    PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_DTLB_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+const char* const PERF_COUNTER_NAMES[PERF_COUNTER_COUNT] = {
+    "cycles", "instructions", "branch-misses", "stalled-cycles",
+    "L1D-misses", "LLC-misses", "dTLB-misses"
+};
+
+// Summed counts over all measured threads and start/stop intervals,
+// scaled up for any time the kernel multiplexed a group out.
+struct PerfSample {
+    double count[PERF_COUNTER_COUNT] = {};
+    bool valid[PERF_COUNTER_COUNT] = {};
+
+    bool has(PerfCounter c) const { return valid[c]; }
+    double operator[](PerfCounter c) const { return count[c]; }
+
+    void add(const PerfSample& other) {
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+            count[c] += other.count[c];
+            valid[c] = valid[c] || other.valid[c];
+        }
+    }
+
+    double ipc() const {
+        return has(PERF_CYCLES) && has(PERF_INSTRUCTIONS) && count[PERF_CYCLES] > 0
+            ? count[PERF_INSTRUCTIONS] / count[PERF_CYCLES] : 0.0;
+    }
+    // Events per thousand instructions.
+    double mpki(PerfCounter c) const {
+        return has(c) && has(PERF_INSTRUCTIONS) && count[PERF_INSTRUCTIONS] > 0
+            ? 1000.0 * count[c] / count[PERF_INSTRUCTIONS] : 0.0;
+    }
+};
+
+#ifdef __linux__
+
+inline int perf_event_open(perf_event_attr* attr, int group_fd) {
+    return static_cast<int>(syscall(SYS_perf_event_open, attr, 0, -1, group_fd, 0));
+}
+
+inline uint64_t perf_cache_config(unsigned cache, unsigned op, unsigned result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+// perf_event_attr type/config candidates per counter, first that opens wins.
+inline std::vector<std::pair<uint32_t, uint64_t>> perf_event_candidates(PerfCounter c) {
+    switch (c) {
+    case PERF_CYCLES:         return { { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES } };
+    case PERF_INSTRUCTIONS:   return { { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS } };
+    case PERF_BRANCH_MISSES:  return { { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES } };
+    case PERF_STALLED_CYCLES: return { { PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND },
+                                       { PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND } };
+    case PERF_L1D_MISSES:     return { { PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_L1D,
+                                         PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) } };
+    case PERF_LLC_MISSES:     return { { PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_LL,
+                                         PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+                                       { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES } };
+    case PERF_DTLB_MISSES:    return { { PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_DTLB,
+                                         PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) } };
+    default:                  return {};
+    }
+}
+
+// One perf group for the calling thread: the first event that opens leads,
+// the others follow it, and all are enabled, disabled and read together.
+class PerfGroup {
+public:
+    PerfGroup() = default;
+    PerfGroup(const PerfGroup&) = delete;
+    PerfGroup& operator=(const PerfGroup&) = delete;
+    ~PerfGroup() { close(); }
+
+    // Returns errno of the first failure when nothing could be opened, else 0.
+    int open(const std::vector<PerfCounter>& counters) {
+        int error = 0;
+        for (PerfCounter c : counters) {
+            for (const auto& candidate : perf_event_candidates(c)) {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = candidate.first;
+                attr.config = candidate.second;
+                attr.disabled = leader_ < 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                int fd = perf_event_open(&attr, leader_);
+                if (fd < 0) {
+                    error = error ? error : errno;
+                    continue;
+                }
+                if (leader_ < 0)
+                    leader_ = fd;
+                fds_.push_back(fd);
+                counters_.push_back(c);
+                break;
+            }
+        }
+        return counters_.empty() ? error : 0;
+    }
+
+    bool is_open() const { return leader_ >= 0; }
+
+    void start() {
+        if (leader_ < 0)
+            return;
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    // Disables the group and adds its counts since start() to `total`.
+    void stop(PerfSample& total) {
+        if (leader_ < 0)
+            return;
+        ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        std::vector<uint64_t> data(3 + fds_.size());
+        if (::read(leader_, data.data(), data.size() * sizeof(uint64_t)) <= 0)
+            return;
+        uint64_t enabled = data[1], running = data[2];
+        if (running == 0)
+            return; // never scheduled: too many events for the PMU
+        double scale = double(enabled) / running;
+        for (size_t i = 0; i < counters_.size() && i < data[0]; i++) {
+            total.count[counters_[i]] += data[3 + i] * scale;
+            total.valid[counters_[i]] = true;
+        }
+    }
+
+    const std::vector<PerfCounter>& counters() const { return counters_; }
+
+private:
+    void close() {
+        for (int fd : fds_)
+            ::close(fd);
+        fds_.clear();
+        counters_.clear();
+        leader_ = -1;
+    }
+
+    int leader_ = -1;
+    std::vector<int> fds_;
+    std::vector<PerfCounter> counters_;
+};
+
+#else
+
+class PerfGroup {
+public:
+    int open(const std::vector<PerfCounter>&) { return ENOSYS; }
+    bool is_open() const { return false; }
+    void start() {}
+    void stop(PerfSample&) {}
+    const std::vector<PerfCounter>& counters() const { return counters_; }
+
+private:
+    std::vector<PerfCounter> counters_;
+};
+
+#endif
+
+// Counters for every worker of a WorkerPool. open() runs on the workers
+// themselves (through pool.run), after which the timed tasks bracket their
+// kernel with start(i) / stop(i). Calls from any other thread, e.g. a
+// worker of a different pool, are ignored. Counts accumulate until reset().
+class PoolCounters {
+public:
+    template <typename Pool>
+    void open(Pool& pool) {
+        groups_.clear();
+        for (int i = 0; i < pool.size(); i++)
+            groups_.emplace_back(new ThreadGroups());
+        errors_.assign(pool.size(), 0);
+        pool.run(pool.size(), [&](int i) {
+            groups_[i]->thread = std::this_thread::get_id();
+            int core = groups_[i]->core.open({ PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_STALLED_CYCLES });
+            int memory = groups_[i]->memory.open({ PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_DTLB_MISSES });
+            errors_[i] = core ? core : memory;
+        });
+        reset();
+    }
+
+    bool available() const { return !groups_.empty() && (groups_[0]->core.is_open() || groups_[0]->memory.is_open()); }
+
+    void reset() {
+        for (auto& g : groups_)
+            g->total = PerfSample();
+    }
+
+    void start(int worker) {
+        if (owns(worker)) {
+            groups_[worker]->core.start();
+            groups_[worker]->memory.start();
+        }
+    }
+
+    void stop(int worker) {
+        if (owns(worker)) {
+            groups_[worker]->memory.stop(groups_[worker]->total);
+            groups_[worker]->core.stop(groups_[worker]->total);
+        }
+    }
+
+    // Sum over workers 0..count-1 since the last reset().
+    PerfSample total(int count) const {
+        PerfSample sum;
+        for (int i = 0; i < count && i < static_cast<int>(groups_.size()); i++)
+            sum.add(groups_[i]->total);
+        return sum;
+    }
+
+    // One worker's counts since the last reset().
+    PerfSample worker(int worker) const {
+        return worker < static_cast<int>(groups_.size()) ? groups_[worker]->total : PerfSample();
+    }
+
+    // "Perf counters: cycles instructions ..." or why there are none.
+    std::string describe() const {
+        if (!available()) {
+            std::string text = "Perf counters: unavailable";
+#ifdef __linux__
+            int error = errors_.empty() ? 0 : errors_[0];
+            if (error == ENOENT || error == EOPNOTSUPP)
+                text += " (no hardware events, e.g. no PMU in this VM)";
+            else if (error == EACCES || error == EPERM)
+                text += " (not permitted, lower perf_event_paranoid or grant CAP_PERFMON)";
+            else if (error)
+                text += std::string(" (") + std::strerror(error) + ")";
+            std::string paranoid = read_sysfs_line("/proc/sys/kernel/perf_event_paranoid");
+            if (!paranoid.empty())
+                text += ", perf_event_paranoid=" + paranoid;
+#endif
+            return text;
+        }
+        std::string text = "Perf counters:";
+        for (const PerfGroup* g : { &groups_[0]->core, &groups_[0]->memory })
+            for (PerfCounter c : g->counters())
+                text += std::string(" ") + PERF_COUNTER_NAMES[c];
+        return text;
+    }
+
+private:
+    struct ThreadGroups {
+        PerfGroup core, memory;
+        PerfSample total;
+        std::thread::id thread;
+    };
+
+    bool owns(int worker) const {
+        return worker < static_cast<int>(groups_.size()) && groups_[worker]->thread == std::this_thread::get_id();
+    }
+
+    std::vector<std::unique_ptr<ThreadGroups>> groups_;
+    std::vector<int> errors_;
+};
+
+// "IPC 2.31, stalled 12.0%, L1D 3.1 MPKI, ..." with whatever was counted,
+// or an empty string.
+inline std::string format_perf(const PerfSample& s) {
+    std::string text;
+    char buffer[64];
+    auto append = [&](const char* format, double value) {
+        std::snprintf(buffer, sizeof(buffer), format, value);
+        text += (text.empty() ? "" : ", ") + std::string(buffer);
+    };
+    if (s.has(PERF_CYCLES) && s.has(PERF_INSTRUCTIONS))
+        append("IPC %.2f", s.ipc());
+    if (s.has(PERF_STALLED_CYCLES) && s.has(PERF_CYCLES) && s[PERF_CYCLES] > 0)
+        append("stalled %.1f%%", 100.0 * s[PERF_STALLED_CYCLES] / s[PERF_CYCLES]);
+    if (!s.has(PERF_INSTRUCTIONS))
+        return text;
+    if (s.has(PERF_L1D_MISSES))
+        append("L1D %.2f MPKI", s.mpki(PERF_L1D_MISSES));
+    if (s.has(PERF_LLC_MISSES))
+        append("LLC %.2f MPKI", s.mpki(PERF_LLC_MISSES));
+    if (s.has(PERF_DTLB_MISSES))
+        append("dTLB %.3f MPKI", s.mpki(PERF_DTLB_MISSES));
+    if (s.has(PERF_BRANCH_MISSES))
+        append("branch %.3f MPKI", s.mpki(PERF_BRANCH_MISSES));
+    return text;
+}
@@ -0,0 +1,693 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+#include <immintrin.h>
+
+#include "affinity.h"
+#include "bench_args.h"
+#include "bench_report.h"
+#include "bench_stats.h"
+#include "cpu_clock.h"
+#include "cpu_topology.h"
+#include "worker_pool.h"
+
+std::vector<int> thread_cpus; // CPUs taking part, from --affinity
+MeasureConfig measure_config; // warmup and repetitions, from --warmup/--reps/...
+BenchReport report; // --json/--csv/--compare
+int critical_section = 4;         // --cs: word updates inside each lock / between operations
+uint64_t ops_per_thread = 20000;  // --ops: operations per thread per sample
+
+//------------------------//
+// Core-to-core latency
+//------------------------//
+
+// The line the two threads hand back and forth, alone in its cache line.
+struct alignas(64) PingPongLine {
+    std::atomic<uint64_t> value;
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+PingPongLine ping_pong;
+
+enum HandoffKind {
+    HANDOFF_STORE_LOAD,  // one side stores, the other spins on loads
+    HANDOFF_CAS          // both sides spin on compare-exchange
+};
+
+const char* const HANDOFF_NAMES[] = { "store/load", "CAS" };
+const char* const HANDOFF_IDS[] = { "store_load", "cas" };
+
+// Waits until the line holds `expected`, then writes `next`. The spins have
+// no PAUSE: it would add its own delay to every handoff.
+inline void hand_off(HandoffKind kind, uint64_t expected, uint64_t next) {
+    if (kind == HANDOFF_STORE_LOAD) {
+        while (ping_pong.value.load(std::memory_order_acquire) != expected)
+            ;
+        ping_pong.value.store(next, std::memory_order_release);
+    } else {
+        uint64_t current = expected;
+        while (!ping_pong.value.compare_exchange_weak(current, next, std::memory_order_acq_rel))
+            current = expected;
+    }
+}
+
+// Seconds for `rounds` round trips between workers 0 and 1: worker 0 sends
+// odd values, worker 1 answers with the next even one. One untimed round
+// first, so the start-up skew of the pair stays out of worker 0's timing.
+double time_round_trips(WorkerPool& pair, HandoffKind kind, uint64_t rounds) {
+    double seconds = 0;
+    ping_pong.value.store(0);
+    pair.run(2, [&](int i) {
+        if (i == 0) {
+            hand_off(kind, 0, 1);
+            hand_off(kind, 2, 3);
+            uint64_t start = timer_begin();
+            for (uint64_t r = 1; r <= rounds; r++)
+                hand_off(kind, 2 * r + 2, 2 * r + 3);
+            seconds = timer_seconds(timer_end() - start);
+            hand_off(kind, 2 * rounds + 4, 2 * rounds + 5);
+        } else {
+            for (uint64_t r = 0; r <= rounds + 2; r++)
+                hand_off(kind, 2 * r + 1, 2 * r + 2);
+        }
+    });
+    return seconds;
+}
+
+// How two logical CPUs relate, innermost shared level first.
+std::string cpu_relation(const CpuTopology& topology, int a, int b) {
+    std::vector<int> siblings = topology.smt_siblings(a);
+    if (std::find(siblings.begin(), siblings.end(), b) != siblings.end())
+        return "SMT sibling";
+    const CacheLevel* llc = topology.last_level_cache();
+    if (llc) {
+        for (const std::vector<int>& instance : llc->instances) {
+            bool has_a = std::find(instance.begin(), instance.end(), a) != instance.end();
+            bool has_b = std::find(instance.begin(), instance.end(), b) != instance.end();
+            if (has_a && has_b)
+                return "same L" + std::to_string(llc->level);
+            if (has_a || has_b)
+                break;
+        }
+    }
+    auto package_of = [&](int cpu) {
+        for (const LogicalCpu& c : topology.cpus)
+            if (c.cpu == cpu)
+                return c.package;
+        return -1;
+    };
+    return package_of(a) == package_of(b) ? "same package" : "cross package";
+}
+
+// Round-trip latency for every pair of the selected CPUs, with both
+// handoff kinds. Each pair gets its own two-worker pool; the matrix is
+// symmetric, so only i < j is measured and mirrored.
+int run_core_to_core(uint64_t rounds) {
+    std::vector<int> cpus = thread_cpus;
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    if (cpus.size() < 2 || cpus[0] < 0) {
+        std::cerr << "The core-to-core matrix needs at least two distinct pinned CPUs\n";
+        return 1;
+    }
+    const CpuTopology& topology = cpu_topology();
+    size_t n = cpus.size();
+
+    std::cout << "Core-to-core round trip, " << rounds << " handoffs per sample, median ns\n";
+    for (int kind = HANDOFF_STORE_LOAD; kind <= HANDOFF_CAS; kind++) {
+        std::vector<std::vector<double>> matrix(n, std::vector<double>(n, 0.0));
+        std::vector<std::string> classes;
+        std::vector<std::vector<double>> by_class;
+
+        for (size_t a = 0; a < n; a++) {
+            for (size_t b = a + 1; b < n; b++) {
+                WorkerPool pair({ cpus[a], cpus[b] });
+                SampleStats stats = measure(measure_config, [&] {
+                    return time_round_trips(pair, HandoffKind(kind), rounds);
+                });
+                double ns = stats.median * 1e9 / rounds;
+                matrix[a][b] = matrix[b][a] = ns;
+                report.add_time("c2c", {{"op", HANDOFF_IDS[kind]}, {"cpu_a", std::to_string(cpus[a])},
+                                        {"cpu_b", std::to_string(cpus[b])}},
+                                "round_trip", "ns", stats, 1e9 / rounds);
+
+                std::string relation = cpu_relation(topology, cpus[a], cpus[b]);
+                size_t c = std::find(classes.begin(), classes.end(), relation) - classes.begin();
+                if (c == classes.size()) {
+                    classes.push_back(relation);
+                    by_class.push_back(std::vector<double>());
+                }
+                by_class[c].push_back(ns);
+            }
+        }
+
+        std::cout << "-----------------------\n";
+        std::cout << HANDOFF_NAMES[kind] << " (rows and columns: CPU)\n";
+        // Columns as wide as the widest CPU number or value plus a space.
+        int width = 6;
+        for (size_t a = 0; a < n; a++) {
+            width = std::max<int>(width, std::to_string(cpus[a]).size() + 1);
+            for (size_t b = 0; b < n; b++)
+                width = std::max<int>(width, std::to_string(std::llround(matrix[a][b])).size() + 1);
+        }
+        std::cout << std::fixed << std::setprecision(0) << std::setw(width) << "";
+        for (int cpu : cpus)
+            std::cout << std::setw(width) << cpu;
+        std::cout << "\n";
+        for (size_t a = 0; a < n; a++) {
+            std::cout << std::setw(width) << cpus[a];
+            for (size_t b = 0; b < n; b++) {
+                if (a == b)
+                    std::cout << std::setw(width) << "-";
+                else
+                    std::cout << std::setw(width) << matrix[a][b];
+            }
+            std::cout << "\n";
+        }
+
+        // The boundaries in numbers: pairs grouped by what they share.
+        std::cout << std::setprecision(1);
+        for (size_t c = 0; c < classes.size(); c++) {
+            std::vector<double>& values = by_class[c];
+            std::sort(values.begin(), values.end());
+            std::cout << std::setw(16) << classes[c] << ": median " << percentile(values, 0.5) << " ns, min "
+                      << values.front() << ", max " << values.back() << " over " << values.size() << " pairs\n";
+            report.add_value("c2c", {{"op", HANDOFF_IDS[kind]}, {"relation", classes[c]}},
+                             "round_trip_median", "ns", percentile(values, 0.5), false);
+        }
+    }
+    return 0;
+}
+
+//------------------------//
+// Contention scaling
+//------------------------//
+
+const int MAX_SYNC_THREADS = 1024;
+const uint64_t RING_SIZE = 1024; // queue capacity, a power of two
+
+// One value, alone in its cache line when Padded. The shared layout packs
+// every hot word of a primitive (lock word, protected data, queue indices,
+// per-thread words) next to each other, as a struct written without care
+// for cache lines would; the padded layout gives each its own line.
+template <typename T, bool Padded>
+struct alignas(Padded ? 64 : alignof(T)) Cell {
+    T value;
+};
+
+typedef std::atomic<uint64_t> Word;
+
+// `length` dependent read-modify-writes of one word: the critical section
+// inside the locks, the work between operations for atomics and queues.
+inline void touch(Word& word, int length) {
+    for (int i = 0; i < length; i++)
+        word.store(word.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// Each primitive is a struct with operation(thread, threads), one
+// acquire/release, update or queue transfer, and active(threads), the
+// threads doing operations (SPSC pairs leave an odd thread idle).
+// Value-initialized, so zeroed, and 64-byte aligned by measure_primitive().
+
+template <bool Padded>
+struct FetchAddBench {
+    Cell<Word, Padded> counter;
+    Cell<Word, Padded> own[MAX_SYNC_THREADS];
+    static int active(int threads) { return threads; }
+    void operation(int thread, int) {
+        counter.value.fetch_add(1, std::memory_order_relaxed);
+        touch(own[thread].value, critical_section);
+    }
+};
+
+template <bool Padded>
+struct CasLoopBench {
+    Cell<Word, Padded> counter;
+    Cell<Word, Padded> own[MAX_SYNC_THREADS];
+    static int active(int threads) { return threads; }
+    void operation(int thread, int) {
+        uint64_t current = counter.value.load(std::memory_order_relaxed);
+        while (!counter.value.compare_exchange_weak(current, current + 1, std::memory_order_relaxed))
+            ;
+        touch(own[thread].value, critical_section);
+    }
+};
+
+template <bool Padded>
+struct MutexBench {
+    Cell<std::mutex, Padded> lock;
+    Cell<Word, Padded> data;
+    static int active(int threads) { return threads; }
+    void operation(int, int) {
+        std::lock_guard<std::mutex> guard(lock.value);
+        touch(data.value, critical_section);
+    }
+};
+
+// Test-and-test-and-set: waiters spin on a plain load, so only the
+// release and the next exchange move the line.
+template <bool Padded>
+struct SpinlockBench {
+    Cell<std::atomic<bool>, Padded> locked;
+    Cell<Word, Padded> data;
+    static int active(int threads) { return threads; }
+    void operation(int, int) {
+        while (locked.value.exchange(true, std::memory_order_acquire))
+            while (locked.value.load(std::memory_order_relaxed))
+                _mm_pause();
+        touch(data.value, critical_section);
+        locked.value.store(false, std::memory_order_release);
+    }
+};
+
+// FIFO: each thread takes a ticket and waits for it to be served.
+template <bool Padded>
+struct TicketBench {
+    Cell<Word, Padded> next;
+    Cell<Word, Padded> serving;
+    Cell<Word, Padded> data;
+    static int active(int threads) { return threads; }
+    void operation(int, int) {
+        uint64_t ticket = next.value.fetch_add(1, std::memory_order_relaxed);
+        while (serving.value.load(std::memory_order_acquire) != ticket)
+            _mm_pause();
+        touch(data.value, critical_section);
+        serving.value.store(ticket + 1, std::memory_order_release);
+    }
+};
+
+// MCS queue lock: each waiter spins on its own node, and the holder hands
+// the lock to its successor directly.
+struct McsNode {
+    std::atomic<McsNode*> next;
+    std::atomic<bool> locked;
+};
+
+template <bool Padded>
+struct McsBench {
+    Cell<std::atomic<McsNode*>, Padded> tail;
+    Cell<Word, Padded> data;
+    Cell<McsNode, Padded> nodes[MAX_SYNC_THREADS];
+    static int active(int threads) { return threads; }
+    void operation(int thread, int) {
+        McsNode& node = nodes[thread].value;
+        node.next.store(nullptr, std::memory_order_relaxed);
+        node.locked.store(true, std::memory_order_relaxed);
+        McsNode* previous = tail.value.exchange(&node, std::memory_order_acq_rel);
+        if (previous) {
+            previous->next.store(&node, std::memory_order_release);
+            while (node.locked.load(std::memory_order_acquire))
+                _mm_pause();
+        }
+
+        touch(data.value, critical_section);
+
+        McsNode* successor = node.next.load(std::memory_order_acquire);
+        if (!successor) {
+            McsNode* expected = &node;
+            if (tail.value.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel))
+                return;
+            while (!(successor = node.next.load(std::memory_order_acquire)))
+                _mm_pause();
+        }
+        successor->locked.store(false, std::memory_order_release);
+    }
+};
+
+// Lamport ring per producer/consumer pair: threads 2k and 2k+1 share ring
+// k. An operation is one push or one pop.
+template <bool Padded>
+struct SpscRing {
+    Cell<Word, Padded> head;  // next slot to pop, written by the consumer
+    Cell<Word, Padded> tail;  // next slot to push, written by the producer
+    uint64_t items[RING_SIZE];
+};
+
+template <bool Padded>
+struct SpscBench {
+    SpscRing<Padded> rings[MAX_SYNC_THREADS / 2];
+    Cell<Word, Padded> own[MAX_SYNC_THREADS];
+    static int active(int threads) { return threads / 2 * 2; }
+    void operation(int thread, int threads) {
+        if (thread >= active(threads))
+            return;
+        SpscRing<Padded>& ring = rings[thread / 2];
+        if (thread % 2 == 0) {
+            uint64_t t = ring.tail.value.load(std::memory_order_relaxed);
+            while (t - ring.head.value.load(std::memory_order_acquire) == RING_SIZE)
+                _mm_pause();
+            ring.items[t & (RING_SIZE - 1)] = t;
+            ring.tail.value.store(t + 1, std::memory_order_release);
+        } else {
+            uint64_t h = ring.head.value.load(std::memory_order_relaxed);
+            while (ring.tail.value.load(std::memory_order_acquire) == h)
+                _mm_pause();
+            own[thread].value.store(ring.items[h & (RING_SIZE - 1)], std::memory_order_relaxed);
+            ring.head.value.store(h + 1, std::memory_order_release);
+        }
+        touch(own[thread].value, critical_section);
+    }
+};
+
+// Bounded MPMC queue (Vyukov): every cell carries a sequence number that
+// tells producers and consumers whose turn it is. An operation is one
+// enqueue followed by one dequeue, so any thread count makes progress.
+struct MpmcCell {
+    Word sequence;
+    uint64_t data;
+};
+
+template <bool Padded>
+struct MpmcBench {
+    Cell<Word, Padded> enqueue_pos;
+    Cell<Word, Padded> dequeue_pos;
+    Cell<MpmcCell, Padded> cells[RING_SIZE];
+    Cell<Word, Padded> own[MAX_SYNC_THREADS];
+
+    MpmcBench() : enqueue_pos(), dequeue_pos(), cells(), own() {
+        for (uint64_t i = 0; i < RING_SIZE; i++)
+            cells[i].value.sequence.store(i, std::memory_order_relaxed);
+    }
+    static int active(int threads) { return threads; }
+
+    void enqueue(uint64_t data) {
+        uint64_t pos = enqueue_pos.value.load(std::memory_order_relaxed);
+        for (;;) {
+            MpmcCell& cell = cells[pos & (RING_SIZE - 1)].value;
+            int64_t diff = int64_t(cell.sequence.load(std::memory_order_acquire)) - int64_t(pos);
+            if (diff == 0) {
+                if (enqueue_pos.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = data;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return;
+                }
+            } else {
+                if (diff < 0)
+                    _mm_pause();  // full
+                pos = enqueue_pos.value.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    uint64_t dequeue() {
+        uint64_t pos = dequeue_pos.value.load(std::memory_order_relaxed);
+        for (;;) {
+            MpmcCell& cell = cells[pos & (RING_SIZE - 1)].value;
+            int64_t diff = int64_t(cell.sequence.load(std::memory_order_acquire)) - int64_t(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    uint64_t data = cell.data;
+                    cell.sequence.store(pos + RING_SIZE, std::memory_order_release);
+                    return data;
+                }
+            } else {
+                if (diff < 0)
+                    _mm_pause();  // empty
+                pos = dequeue_pos.value.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void operation(int thread, int) {
+        enqueue(thread);
+        own[thread].value.store(dequeue(), std::memory_order_relaxed);
+        touch(own[thread].value, critical_section);
+    }
+};
+
+struct SyncResult {
+    SampleStats stats;     // seconds per sample
+    double operations = 0; // per sample, all threads
+    SampleStats p50, p99, p999; // ns per operation, one sample per latency run
+};
+
+// Throughput from untimed operations through the harness, then separate runs
+// that read the TSC around every operation for the latency percentiles, so
+// the per-operation timestamps never slow the throughput samples. Each
+// latency run gives one sample of every percentile; there are as many runs
+// as the harness takes at least (--reps, else --min-reps, at least 2).
+template <typename Bench>
+SyncResult measure_primitive(WorkerPool& pool, int threads) {
+    SyncResult result;
+    int active = Bench::active(threads);
+    if (active == 0)
+        return result;
+
+    void* memory = _mm_malloc(sizeof(Bench), 64);
+    Bench* bench = new (memory) Bench();
+
+    result.operations = double(active) * ops_per_thread;
+    result.stats = measure(measure_config, [&] {
+        return pool.run(threads, [&](int i) {
+            for (uint64_t k = 0; k < ops_per_thread; k++)
+                bench->operation(i, threads);
+        });
+    });
+
+    std::vector<std::vector<uint64_t>> ticks(threads, std::vector<uint64_t>(ops_per_thread));
+    int runs = std::max(measure_config.repetitions > 0 ? measure_config.repetitions : measure_config.min_samples, 2);
+    std::vector<double> p50, p99, p999, latency;
+    for (int run = 0; run < runs; run++) {
+        pool.run(threads, [&](int i) {
+            uint64_t* out = ticks[i].data();
+            for (uint64_t k = 0; k < ops_per_thread; k++) {
+                uint64_t start = __rdtsc();
+                bench->operation(i, threads);
+                out[k] = __rdtsc() - start;
+            }
+        });
+        latency.clear();
+        for (int i = 0; i < active; i++)
+            for (uint64_t t : ticks[i])
+                latency.push_back(t * 1e9 / tsc_info().hz);
+        std::sort(latency.begin(), latency.end());
+        p50.push_back(percentile(latency, 0.5));
+        p99.push_back(percentile(latency, 0.99));
+        p999.push_back(percentile(latency, 0.999));
+    }
+    result.p50 = summarize(p50, measure_config.outlier_mad);
+    result.p99 = summarize(p99, measure_config.outlier_mad);
+    result.p999 = summarize(p999, measure_config.outlier_mad);
+
+    bench->~Bench();
+    _mm_free(memory);
+    return result;
+}
+
+struct SyncPrimitive {
+    const char* name;
+    const char* layout;
+    SyncResult (*run)(WorkerPool& pool, int threads);
+};
+
+#define SYNC_PRIMITIVE(name, Bench) \
+    { name, "shared", measure_primitive<Bench<false>> }, { name, "padded", measure_primitive<Bench<true>> }
+
+const SyncPrimitive SYNC_PRIMITIVES[] = {
+    SYNC_PRIMITIVE("fetch_add", FetchAddBench),
+    SYNC_PRIMITIVE("CAS loop", CasLoopBench),
+    SYNC_PRIMITIVE("std::mutex", MutexBench),
+    SYNC_PRIMITIVE("spinlock", SpinlockBench),
+    SYNC_PRIMITIVE("ticket", TicketBench),
+    SYNC_PRIMITIVE("MCS", McsBench),
+    SYNC_PRIMITIVE("SPSC ring", SpscBench),
+    SYNC_PRIMITIVE("MPMC ring", MpmcBench),
+};
+
+// Every primitive and layout for 1..N threads on the --affinity order.
+// Throughput counts operations of all threads; latency is per operation,
+// waiting included, the median percentile over the latency runs.
+int run_contention(WorkerPool& pool) {
+    int max_threads = std::min<int>(thread_cpus.size(), MAX_SYNC_THREADS);
+    std::cout << "Contention: " << ops_per_thread << " operations per thread per sample, critical section "
+              << critical_section << " word updates\n";
+    std::cout << "Throughput in median Mops/s; latency per operation in ns (TSC)\n";
+
+    for (int threads = 1; threads <= max_threads; threads++) {
+        std::cout << "-----------------------\n";
+        std::cout << "Threads: " << threads << "\n";
+        std::cout << std::left << std::setw(12) << "Primitive" << std::setw(8) << "Layout" << std::right
+                  << std::setw(10) << "Mops/s" << std::setw(10) << "p50" << std::setw(10) << "p99"
+                  << std::setw(10) << "p99.9" << std::setw(8) << "CI95" << "\n";
+        for (const SyncPrimitive& p : SYNC_PRIMITIVES) {
+            std::cout << std::left << std::setw(12) << p.name << std::setw(8) << p.layout << std::right;
+            SyncResult r = p.run(pool, threads);
+            if (r.operations == 0) {
+                std::cout << "  needs two threads\n";
+                continue;
+            }
+            std::cout << std::fixed << std::setprecision(2) << std::setw(10) << r.operations / r.stats.median / 1e6
+                      << std::setprecision(1) << std::setw(10) << r.p50.median << std::setw(10) << r.p99.median
+                      << std::setw(10) << r.p999.median << std::setw(7) << 100.0 * r.stats.ci << "%\n";
+
+            ResultParams params = {{"primitive", p.name}, {"layout", p.layout}, {"threads", std::to_string(threads)},
+                                   {"cs", std::to_string(critical_section)}};
+            report.add_rate("contention", params, "throughput", "Mops/s", r.stats, r.operations / 1e6);
+            report.add_time("contention", params, "latency_p50", "ns", r.p50, 1.0);
+            report.add_time("contention", params, "latency_p99", "ns", r.p99, 1.0);
+            report.add_time("contention", params, "latency_p999", "ns", r.p999, 1.0);
+        }
+    }
+    return 0;
+}
+
+//------------------------//
+// False sharing
+//------------------------//
+
+const uint64_t SHARING_UPDATES = 1 << 20; // per thread per sample
+const size_t SHARING_STRIDES[] = { 8, 16, 32, 64, 128, 256 };
+
+// Where one thread's words live: `first` always, `second` for the
+// two-field record layouts.
+struct SharingWords {
+    volatile uint64_t* first;
+    volatile uint64_t* second;
+};
+
+// The thread's private words, updated through volatile so every update is
+// a load and a store that need the line in this core's L1. Nothing is
+// shared: any slowdown over one thread is the lines bouncing.
+void update_words(SharingWords words, uint64_t updates) {
+    for (uint64_t i = 0; i < updates; i++) {
+        *words.first += 1;
+        if (words.second)
+            *words.second += i;
+    }
+}
+
+// Seconds per sample with `threads` workers, worker i on words(i).
+template <typename Words>
+SampleStats measure_sharing(WorkerPool& pool, int threads, Words words) {
+    return measure(measure_config, [&] {
+        return pool.run(threads, [&](int i) { update_words(words(i), SHARING_UPDATES); });
+    });
+}
+
+// Per-thread counters `stride` bytes apart, then per-thread {count, total}
+// records as AoS (record i holds both of thread i's words) and SoA (one
+// array per field), packed and padded to a line per thread. Each row is
+// one thread alone against all --affinity threads at once; a 64 B stride
+// that is still slower than 128 B shows the adjacent-line prefetcher
+// pairing lines.
+int run_false_sharing(WorkerPool& pool) {
+    int threads = pool.size();
+    if (threads < 2) {
+        std::cerr << "False sharing needs at least two threads\n";
+        return 1;
+    }
+    size_t line = cpu_topology().line_size();
+    size_t field_bytes = size_t(threads) * 256; // the widest stride
+    char* memory = static_cast<char*>(_mm_malloc(2 * field_bytes, 4096));
+    std::fill(memory, memory + 2 * field_bytes, 0);
+    auto word = [&](size_t offset) { return reinterpret_cast<volatile uint64_t*>(memory + offset); };
+
+    std::cout << "False sharing: " << SHARING_UPDATES << " updates per thread per sample, "
+              << line << " B lines, median ns per update\n";
+    std::cout << "-----------------------\n";
+    std::cout << std::left << std::setw(16) << "Layout" << std::right << std::setw(10) << "1 thread"
+              << std::setw(12) << (std::to_string(threads) + " threads") << std::setw(10) << "Slowdown" << "\n";
+
+    auto row = [&](const std::string& layout, const std::string& stride, const SampleStats& one,
+                   const SampleStats& all) {
+        double one_ns = one.median * 1e9 / SHARING_UPDATES;
+        double all_ns = all.median * 1e9 / SHARING_UPDATES;
+        std::cout << std::left << std::setw(16) << layout << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << one_ns << std::setw(12) << all_ns << std::setw(9) << all_ns / one_ns << "x\n";
+        ResultParams params = {{"layout", layout}, {"stride", stride}, {"threads", "1"}};
+        report.add_time("false_sharing", params, "update", "ns", one, 1e9 / SHARING_UPDATES);
+        params.back().second = std::to_string(threads);
+        report.add_time("false_sharing", params, "update", "ns", all, 1e9 / SHARING_UPDATES);
+        return all_ns;
+    };
+
+    std::vector<double> stride_ns;
+    for (size_t stride : SHARING_STRIDES) {
+        auto words = [&](int i) { return SharingWords{ word(i * stride), nullptr }; };
+        SampleStats one = measure_sharing(pool, 1, words);
+        SampleStats all = measure_sharing(pool, threads, words);
+        stride_ns.push_back(row("stride " + std::to_string(stride) + " B", std::to_string(stride), one, all));
+    }
+
+    for (size_t padded = 0; padded < 2; padded++) {
+        size_t record = padded ? line : 2 * sizeof(uint64_t);
+        size_t entry = padded ? line : sizeof(uint64_t);
+        auto aos = [&](int i) { return SharingWords{ word(i * record), word(i * record + sizeof(uint64_t)) }; };
+        auto soa = [&](int i) { return SharingWords{ word(i * entry), word(field_bytes + i * entry) }; };
+        std::string suffix = padded ? " padded" : "";
+        row("AoS" + suffix, std::to_string(record), measure_sharing(pool, 1, aos), measure_sharing(pool, threads, aos));
+        row("SoA" + suffix, std::to_string(entry), measure_sharing(pool, 1, soa), measure_sharing(pool, threads, soa));
+    }
+
+    // The smallest stride from which every wider one is within 10% of the
+    // widest: the distance threads' data must keep on this host.
+    if (threads > 1) {
+        size_t count = sizeof(SHARING_STRIDES) / sizeof(SHARING_STRIDES[0]);
+        size_t clean = count - 1;
+        while (clean > 0 && stride_ns[clean - 1] <= 1.1 * stride_ns[count - 1])
+            clean--;
+        std::cout << "No false sharing from a " << SHARING_STRIDES[clean] << " B stride\n";
+        report.add_value("false_sharing", {{"threads", std::to_string(threads)}}, "clean_stride", "B",
+                         SHARING_STRIDES[clean], false);
+    }
+
+    _mm_free(memory);
+    return 0;
+}
+
+// Usage: sync_bench [c2c] [--rounds=N]   core-to-core round-trip matrix over the selected CPUs
+//                                        (N handoffs per sample, default 10000)
+//        sync_bench contention [--cs=N] [--ops=N]
+//                                        fetch_add, CAS loop, std::mutex, spinlock, ticket and MCS
+//                                        locks, SPSC/MPMC rings in shared and padded layouts for
+//                                        1..N threads; N word updates per critical section
+//                                        (default 4), N operations per thread per sample (default 20000)
+//        sync_bench sharing              per-thread counters 8..256 B apart and AoS/SoA records,
+//                                        one thread against all, to price false sharing
+// Options: --affinity=scatter|compact|physical|<cpu list> (default: every CPU)
+//          --warmup=N --reps=N | --min-reps=N --max-reps=N --max-time=S --ci=PCT, --outliers=K
+//          --json=FILE --csv=FILE --compare=BASELINE.json --threshold=PCT, --timer=tsc|steady
+int main(int argc, char** argv) {
+    report.init("sync_bench", argc, argv);
+    AffinityConfig affinity;
+    thread_cpus = affinity_from_args(argc, argv, affinity);
+    // Many small measurements: a shorter time box than the default.
+    measure_config.max_seconds = 0.25;
+    measure_config_from_args(argc, argv, measure_config);
+    timer_from_args(argc, argv);
+    std::string value;
+    uint64_t rounds = take_option(argc, argv, "--rounds", value) ? std::stoull(value) : 10000;
+    if (take_option(argc, argv, "--cs", value))
+        critical_section = std::max(0, std::stoi(value));
+    if (take_option(argc, argv, "--ops", value))
+        ops_per_thread = std::max<uint64_t>(1, std::stoull(value));
+    report.set_placement(affinity, thread_cpus);
+    report.set_sampling(measure_config);
+
+    std::cout << "CPU: " << cpu_info().brand << "\n";
+    std::cout << describe_measure_config(measure_config) << "\n";
+    std::cout << describe_timer() << "\n";
+    std::cout << describe_topology(cpu_topology()) << "\n";
+    std::cout << describe_affinity(affinity, thread_cpus) << "\n";
+
+    if (argc > 1 && std::string(argv[1]) == "contention") {
+        WorkerPool pool(thread_cpus);
+        return report.finish(run_contention(pool));
+    }
+    if (argc > 1 && std::string(argv[1]) == "sharing") {
+        WorkerPool pool(thread_cpus);
+        return report.finish(run_false_sharing(pool));
+    }
+    if (argc > 1 && std::string(argv[1]) != "c2c") {
+        std::cerr << "Unknown mode '" << argv[1] << "'\n";
+        return report.finish(1);
+    }
+    return report.finish(run_core_to_core(rounds));
+}
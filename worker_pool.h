@@ -0,0 +1,156 @@
+#pragma once
+
+// Persistent, pinned worker threads for timed regions. Threads are created
+// once, so thread creation and teardown never land inside a measurement;
+// each run releases its workers together through a spin barrier and every
+// worker times only its own task with the region timer (cpu_clock.h).
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <immintrin.h>
+
+#include "affinity.h"
+#include "cpu_clock.h"
+
+// In timer ticks (timer_begin/timer_end); see timer_seconds().
+struct ThreadInterval {
+    uint64_t start;
+    uint64_t end;
+};
+
+// One value alone in its cache line, for results every worker writes:
+// neighbouring workers' slots never share a line, so their writes don't
+// bounce it between cores while the measured region runs.
+template <typename T>
+struct alignas(64) WorkerSlot {
+    T value;
+};
+
+class WorkerPool {
+public:
+    // One worker per entry of `cpus`, pinned to it (-1 leaves it unpinned).
+    explicit WorkerPool(const std::vector<int>& cpus)
+        : intervals_(cpus.size()) {
+        for (size_t i = 0; i < cpus.size(); i++)
+            threads_.push_back(std::thread(&WorkerPool::worker_loop, this, static_cast<int>(i), cpus[i]));
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            generation_++;
+        }
+        wake_.notify_all();
+        for (auto& t : threads_)
+            t.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int size() const { return static_cast<int>(threads_.size()); }
+
+    // Runs task(i) on workers 0..count-1 and returns the wall time covered by
+    // the union of their intervals, in seconds. Workers beyond `count` stay
+    // asleep, so they don't compete with the measured ones.
+    double run(int count, const std::function<void(int)>& task) {
+        count = std::min(count, size());
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_ = &task;
+            count_ = count;
+            arrived_.store(0);
+            finished_ = 0;
+            generation_++;
+        }
+        wake_.notify_all();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return finished_ == count_; });
+        task_ = nullptr;
+        return union_seconds(count);
+    }
+
+    // Interval of `worker` in the last run.
+    const ThreadInterval& interval(int worker) const { return intervals_[worker].value; }
+
+private:
+    void worker_loop(int index, int cpu) {
+        pin_current_thread(cpu);
+        unsigned long long seen = 0;
+        for (;;) {
+            const std::function<void(int)>* task;
+            int count;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return generation_ != seen; });
+                seen = generation_;
+                if (stopping_)
+                    return;
+                task = task_;
+                count = count_;
+            }
+            if (index >= count)
+                continue;
+
+            // Spin rather than block so all workers leave within a few cycles.
+            arrived_.fetch_add(1);
+            while (arrived_.load(std::memory_order_acquire) < count)
+                _mm_pause();
+
+            ThreadInterval& interval = intervals_[index].value;
+            interval.start = timer_begin();
+            (*task)(index);
+            interval.end = timer_end();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                finished_++;
+            }
+            done_.notify_one();
+        }
+    }
+
+    // Length of the union of the first `count` intervals. Normally they
+    // overlap completely and this is simply last end minus first start.
+    double union_seconds(int count) const {
+        std::vector<std::pair<uint64_t, uint64_t>> spans;
+        for (int i = 0; i < count; i++)
+            spans.push_back(std::make_pair(intervals_[i].value.start, intervals_[i].value.end));
+        std::sort(spans.begin(), spans.end());
+
+        uint64_t total = 0;
+        auto current = spans.empty() ? std::make_pair(uint64_t(0), uint64_t(0)) : spans[0];
+        for (size_t i = 1; i < spans.size(); i++) {
+            if (spans[i].first <= current.second) {
+                current.second = std::max(current.second, spans[i].second);
+            } else {
+                total += current.second - current.first;
+                current = spans[i];
+            }
+        }
+        total += current.second - current.first;
+        return timer_seconds(total);
+    }
+
+    std::vector<std::thread> threads_;
+    std::vector<WorkerSlot<ThreadInterval>> intervals_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    unsigned long long generation_ = 0;
+    bool stopping_ = false;
+    const std::function<void(int)>* task_ = nullptr;
+    int count_ = 0;
+    int finished_ = 0;
+    std::atomic<int> arrived_{0};
+};